@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2023 Space Cubics, LLC.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Driver benchmark. Each command is issued CONFIG_APP_BENCHMARK_ITERATIONS
+ * times from this thread and reported as one JSON object per line:
+ *
+ *   {"op":"getparam","n":1000,"ops_per_s":...,"p50_ns":...,"p99_ns":...,
+ *    "max_ns":...,"spi_calls_per_op":4.000,"spi_bytes_per_op":4.000}
+ *
+ * The SPI counts are only reported when the motor is emulated.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/sys/util.h>
+#include <stdlib.h>
+
+#include "l64x0.h"
+#ifdef CONFIG_L64X0_EMUL
+#include "l64x0_emul.h"
+#endif
+
+#define MOTOR_DRIVER DT_NODELABEL(motor_driver)
+#define ITERATIONS CONFIG_APP_BENCHMARK_ITERATIONS
+
+#ifdef CONFIG_L64X0_EMUL
+/* A chain is emulated as a whole, a single chip on its own */
+#define MOTOR_EMUL							\
+	COND_CODE_1(DT_NODE_HAS_COMPAT(DT_PARENT(MOTOR_DRIVER),		\
+				       st_l64x0_daisy_chain),		\
+		    (DT_PARENT(MOTOR_DRIVER)), (MOTOR_DRIVER))
+#endif
+
+struct bench_op {
+	const char *name;
+	void (*fn)(const struct device *dev, int i);
+};
+
+static void bench_setparam(const struct device *dev, int i)
+{
+	l64x0_setparam(dev, L64x0_ADDR_MAX_SPEED, 0x20 + (i & 0xf));
+}
+
+static void bench_getparam(const struct device *dev, int i)
+{
+	uint32_t val;
+
+	(void)l64x0_getparam(dev, L64x0_ADDR_ABS_POS, &val);
+}
+
+static void bench_run(const struct device *dev, int i)
+{
+	l64x0_run(dev, (i & 1) ? 0x1000 : -0x1000);
+}
+
+/* MOVE is refused while the previous one runs, at the same SPI cost */
+static void bench_move(const struct device *dev, int i)
+{
+	l64x0_move(dev, (i & 1) ? 16 : -16);
+}
+
+static void bench_get_status(const struct device *dev, int i)
+{
+	uint16_t status;
+
+	(void)l64x0_get_status(dev, &status);
+}
+
+static const struct bench_op ops[] = {
+	{ "setparam", bench_setparam },
+	{ "getparam", bench_getparam },
+	{ "run", bench_run },
+	{ "move", bench_move },
+	{ "get_status", bench_get_status },
+};
+
+static uint32_t latency_ns[ITERATIONS];
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank percentile of the sorted latencies */
+static uint32_t percentile(int pct)
+{
+	size_t rank = DIV_ROUND_UP((size_t)ITERATIONS * pct, 100);
+
+	return latency_ns[MAX(rank, 1) - 1];
+}
+
+/* A count per operation with three decimals, as a JSON number */
+static void print_per_op(const char *key, uint32_t count)
+{
+	uint64_t milli = (uint64_t)count * 1000U / ITERATIONS;
+
+	printk(",\"%s\":%u.%03u", key, (uint32_t)(milli / 1000U), (uint32_t)(milli % 1000U));
+}
+
+static void bench(const struct device *dev, const struct bench_op *op)
+{
+#ifdef CONFIG_L64X0_EMUL
+	const struct emul *emul = EMUL_DT_GET(MOTOR_EMUL);
+	struct l64x0_emul_stats stats;
+#endif
+	uint32_t total_start;
+	uint64_t total_ns;
+
+#ifdef CONFIG_L64X0_EMUL
+	l64x0_emul_reset_stats(emul);
+#endif
+	total_start = k_cycle_get_32();
+
+	for (int i = 0; i < ITERATIONS; i++) {
+		uint32_t start = k_cycle_get_32();
+
+		op->fn(dev, i);
+		latency_ns[i] = k_cyc_to_ns_floor64(k_cycle_get_32() - start);
+	}
+
+	total_ns = k_cyc_to_ns_floor64(k_cycle_get_32() - total_start);
+
+	qsort(latency_ns, ITERATIONS, sizeof(latency_ns[0]), cmp_u32);
+
+	printk("{\"op\":\"%s\",\"n\":%d,\"ops_per_s\":%u,\"p50_ns\":%u,\"p99_ns\":%u,\"max_ns\":%u",
+	       op->name, ITERATIONS,
+	       (uint32_t)((uint64_t)ITERATIONS * NSEC_PER_SEC / MAX(total_ns, 1)),
+	       percentile(50), percentile(99), latency_ns[ITERATIONS - 1]);
+#ifdef CONFIG_L64X0_EMUL
+	l64x0_emul_get_stats(emul, &stats);
+	print_per_op("spi_calls_per_op", stats.transfers);
+	print_per_op("spi_bytes_per_op", stats.bytes);
+#endif
+	printk("}\n");
+}
+
+int main(void)
+{
+	const struct device *const dev = DEVICE_DT_GET(MOTOR_DRIVER);
+
+	if (!device_is_ready(dev)) {
+		printk("%s: device not ready.\n", dev->name);
+		return EXIT_FAILURE;
+	}
+
+	if (pm_device_runtime_get(dev) < 0) {
+		printk("%s: resume failed.\n", dev->name);
+		return EXIT_FAILURE;
+	}
+
+	printk("{\"bench\":\"l64x0\",\"device\":\"%s\",\"variant\":\"%s\",\"cycles_per_s\":%u}\n",
+	       dev->name, (l64x0_variant(dev) == L64X0_VARIANT_L6480) ? "l6480" : "l6470",
+	       sys_clock_hw_cycles_per_sec());
+
+	for (int i = 0; i < ARRAY_SIZE(ops); i++) {
+		bench(dev, &ops[i]);
+	}
+
+	l64x0_hard_hiz(dev);
+	pm_device_runtime_put(dev);
+	printk("{\"done\":true}\n");
+
+	return EXIT_SUCCESS;
+}
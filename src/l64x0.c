@@ -4,8 +4,6 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#define DT_DRV_COMPAT st_l6470
-
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(l64x0, LOG_LEVEL_DBG);
 
@@ -14,11 +12,197 @@ LOG_MODULE_REGISTER(l64x0, LOG_LEVEL_DBG);
 #include <zephyr/device.h>
 #include <zephyr/drivers/spi.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/pwm.h>
+#include <zephyr/pm/device.h>
+#ifdef CONFIG_L64X0_SENSOR
+#include <zephyr/drivers/sensor.h>
+#endif
 #include <zephyr/sys/util.h>
+#include <zephyr/sys/barrier.h>
 #include <stdlib.h>
+#include <string.h>
 
-struct l64x0_config {
+struct l64x0_bus;
+
+/*
+ * Chip selects of one SPI controller. Their commands take turns here
+ * rather than contending for the controller, which only one chip select
+ * configuration holds at a time (SPI_LOCK_ON).
+ */
+struct l64x0_ctrl {
+	const struct device *spi;
+	sys_snode_t node;
+	/* Chip select currently holding the controller, NULL if released */
+	struct l64x0_bus *owner;
+#ifdef CONFIG_L64X0_ASYNC
+	/* Chip selects served in turn, one frame each */
+	sys_slist_t buses;
+	struct l64x0_bus *cur;
+	struct k_spinlock lock;
+	struct k_work kick;
+	bool busy;
+#else
+	struct k_mutex lock;
+#endif
+#ifdef CONFIG_L64X0_FANOUT
+	/* Sends this controller's share of l64x0_fanout(), NULL if none left */
+	struct k_work_q *workq;
+#endif
+};
+
+/* Chips sharing one chip select, one byte of tx/rx scratch per chip */
+struct l64x0_bus {
 	struct spi_dt_spec spi;
+	struct l64x0_ctrl *ctrl;
+	/* Becomes the controller's scheduler if this bus is the first on it */
+	struct l64x0_ctrl ctrl_storage;
+	uint8_t length;
+	uint8_t *tx;
+	uint8_t *rx;
+	const struct spi_buf_set tx_set;
+	const struct spi_buf_set rx_set;
+	/* Minimum CS high time between two byte times */
+	uint32_t cs_high_ns;
+	uint32_t cs_high_cycles;
+	uint32_t cs_high_start;
+	/* Frame in flight: command of each chip by slot, byte time and length */
+	struct l64x0_cmd **inflight;
+	uint8_t byte;
+	uint8_t frames;
+	bool initialized;
+#ifdef CONFIG_L64X0_ASYNC
+	/* Submission queue of each chip, by slot, under the controller lock */
+	sys_slist_t *queues;
+	sys_snode_t ctrl_node;
+#endif
+};
+
+#ifdef CONFIG_L64X0_TELEMETRY
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_L64X0_TELEMETRY_DEPTH),
+	     "the telemetry depth must be a power of two");
+
+/* seq is odd while the sampler writes the slot, and counts its writes */
+struct l64x0_telemetry_slot {
+	/* Odd while the sampler writes the slot */
+	atomic_t seq;
+	/* Sample number held, wrapping like ring_head */
+	uint32_t idx;
+	struct l64x0_sample sample;
+};
+#endif
+
+/* Per chip register layout */
+struct l64x0_variant {
+	enum l64x0_variant_id id;
+	/* Width of each register, 0 for the ones the chip lacks */
+	uint8_t bit_len[L64x0_ADDR_LAST];
+	/* Address of each register on the chip */
+	uint8_t addr[L64x0_ADDR_LAST];
+	/* STATUS to bitmap of enum l64x0_alarm */
+	uint32_t (*alarms)(uint16_t status);
+};
+
+#ifdef CONFIG_L64X0_SENSOR
+/* Raw registers of one sensor read, as put in RTIO buffers */
+struct l64x0_sensor_frame {
+	uint64_t timestamp_ns;
+	uint32_t abs_pos;
+	uint32_t speed;
+	uint16_t status;
+	uint8_t adc_out;
+	uint8_t variant;
+};
+#endif
+
+struct l64x0_config {
+	const struct l64x0_variant *variant;
+	struct l64x0_bus *bus;
+	/* Position in the daisy chain, 0 being the chip wired to MOSI */
+	uint8_t position;
+	struct gpio_dt_spec stby;
+	/* Optional, port is NULL without flag-gpios */
+	struct gpio_dt_spec flag;
+	/* Optional, port is NULL without busy-gpios */
+	struct gpio_dt_spec busy;
+#ifdef CONFIG_L64X0_STEP_CLOCK
+	/* Optional, dev is NULL without pwms */
+	struct pwm_dt_spec stck;
+#endif
+	/* Registers written at boot, from devicetree */
+	const struct l64x0_profile *init_regs;
+};
+
+#define STBY_OF(dev) (&((const struct l64x0_config *)(dev)->config)->stby)
+
+struct l64x0_data {
+	/* Frame of the single-device commands */
+	struct l64x0_cmd frame;
+	/* Held for a burst of commands, protects the frame and the shadow */
+	struct k_mutex lock;
+	/* Last value written to or read from each register */
+	uint32_t shadow[L64x0_ADDR_LAST];
+	/* Registers whose shadow may not match the chip */
+	atomic_t dirty;
+	/* Registers whose shadow holds what the chip should have */
+	uint32_t known;
+	struct l64x0_error_counters errors;
+	bool recovering;
+#ifdef CONFIG_L64X0_STATS
+	struct l64x0_op_stats stats[L64X0_OP_COUNT];
+#endif
+#ifdef CONFIG_L64X0_SENSOR
+	/* Taken by sample_fetch, decoded by channel_get */
+	struct l64x0_sensor_frame sensor;
+#endif
+#ifdef CONFIG_PM_DEVICE
+	/* Device whose STBY line this one shares; users and lock are its own */
+	const struct device *stby_owner;
+	sys_snode_t stby_node;
+	struct k_mutex stby_lock;
+	uint8_t stby_users;
+	/* Times STBY was asserted, and that count when this device suspended */
+	uint32_t stby_count;
+	uint32_t stby_seen;
+	/* Position registers, not part of the shadow */
+	uint32_t pm_abs_pos;
+	uint32_t pm_mark;
+	bool pm_telemetry;
+#endif
+	/* FLAG interrupt, STATUS is read and decoded from the work item */
+	const struct device *dev;
+	struct gpio_callback flag_cb;
+	struct k_work alarm_work;
+	/* Alarms read by someone else than the work item, for it to dispatch */
+	atomic_t alarm_pending;
+	l64x0_alarm_callback_t alarm_cb[L64X0_ALARM_COUNT];
+	void *alarm_user_data[L64X0_ALARM_COUNT];
+	/* BUSY interrupt, raises idle on the end of a motion */
+	struct gpio_callback busy_cb;
+	struct k_poll_signal idle;
+#ifdef CONFIG_L64X0_MOTION_QUEUE
+	/* Entries wait here until the motion before them has ended */
+	struct k_msgq motion_q;
+	char motion_buf[CONFIG_L64X0_MOTION_QUEUE_DEPTH * sizeof(struct l64x0_motion)];
+	struct k_work_delayable motion_work;
+	struct k_poll_signal motion_done;
+	atomic_t motion_active;
+#endif
+#ifdef CONFIG_L64X0_STEP_CLOCK
+	/* Pulse train on STCK, one segment per timer expiry */
+	struct k_timer stck_timer;
+	const struct l64x0_stck_segment *stck_table;
+	size_t stck_len;
+	size_t stck_next;
+	struct k_poll_signal stck_done;
+#endif
+#ifdef CONFIG_L64X0_TELEMETRY
+	/* Single writer ring, head counts the samples ever taken */
+	struct k_work_delayable telemetry_work;
+	k_timeout_t telemetry_period;
+	uint32_t telemetry_mask;
+	struct l64x0_telemetry_slot ring[CONFIG_L64X0_TELEMETRY_DEPTH];
+	atomic_t ring_head;
+#endif
 };
 
 /* Commands */
@@ -28,6 +212,8 @@ struct l64x0_config {
 #define TX_BYTES_NONE (0)
 #define TX_BYTES_RUN (3)
 #define TX_BYTES_MOVE (3)
+#define TX_BYTES_GOTO (3)
+#define TX_BYTES_GO_UNTIL (3)
 
 #define CMD_NOP          ((0))
 
@@ -38,13 +224,15 @@ struct l64x0_config {
 #define CMD_RUN          ((2 << 5) | BIT(4))
 #define CMD_STEP_CLOCK   ((2 << 5) | BIT(4) | BIT(3))
 
-#define CMD_GOTO         ((3 << 5)
+#define CMD_GOTO         ((3 << 5))
 #define CMD_GOTO_DIR     ((3 << 5) |          BIT(3))
 #define CMD_GO_HOME      ((3 << 5) | BIT(4))
 #define CMD_GO_MARK      ((3 << 5) | BIT(4) | BIT(3))
 
 #define CMD_GO_UNTIL     ((4 << 5) |                   BIT(1))
-#define CMD_RELEASE_SW   ((4 << 5) | BIT(4)            BIT(1))
+#define CMD_RELEASE_SW   ((4 << 5) | BIT(4) |          BIT(1))
+/* GO_UNTIL and RELEASE_SW: copy ABS_POS to MARK instead of resetting it */
+#define CMD_SW_ACT       BIT(3)
 
 #define CMD_SOFT_HIZ     ((5 << 5))
 #define CMD_HARD_HIZ     ((5 << 5) |          BIT(3))
@@ -55,263 +243,3044 @@ struct l64x0_config {
 #define CMD_GET_STATUS   ((6 << 5) | BIT(4))
 #define CMD_RESET_POS    ((6 << 5) | BIT(4) | BIT(3))
 
-#if IS_ENABLED(CONFIG_L6470)
-static int bit_len[] = {
-        [L64x0_ADDR_ABS_POS]    = 22,
-        [L64x0_ADDR_EL_POS]     = 9,
-        [L64x0_ADDR_MARK]       = 22,
-        [L64x0_ADDR_SPEED]      = 20,
-        [L64x0_ADDR_ACC]        = 12,
-        [L64x0_ADDR_DEC]        = 12,
-        [L64x0_ADDR_MAX_SPEED]  = 10,
-        [L64x0_ADDR_MIN_SPEED]  = 13,
-        [L64x0_ADDR_KVAL_HOLD]  = 8,
-        [L64x0_ADDR_KVAL_RUN]   = 8,
-        [L64x0_ADDR_KVAL_ACC]   = 8,
-        [L64x0_ADDR_KVAL_DEC]   = 8,
-        [L64x0_ADDR_INT_SPEED]  = 14,
-        [L64x0_ADDR_ST_SLP]     = 8,
-        [L64x0_ADDR_FN_SLP_ACC] = 8,
-        [L64x0_ADDR_FN_SLP_DEC] = 8,
-        [L64x0_ADDR_K_THERM]    = 4,
-        [L64x0_ADDR_ADC_OUT]    = 5,
-        [L64x0_ADDR_OCD_TH]     = 4,
-        [L64x0_ADDR_STALL_TH]   = 7,
-        [L64x0_ADDR_FS_SPD]     = 10,
-        [L64x0_ADDR_STEP_MODE]  = 8,
-        [L64x0_ADDR_ALARM_EN]   = 8,
-        [L64x0_ADDR_CONFIG]     = 16,
-        [L64x0_ADDR_STATUS]     = 16,
+/* Most fault bits are active low, the others are set on the event */
+static uint32_t l6470_alarms(uint16_t status)
+{
+	uint32_t alarms = 0;
+
+	alarms |= (status & L6470_STATUS_OCD) ? 0 : BIT(L64X0_ALARM_OCD);
+	alarms |= (status & L6470_STATUS_TH_SD) ? 0 : BIT(L64X0_ALARM_TH_SD);
+	alarms |= (status & L6470_STATUS_TH_WRN) ? 0 : BIT(L64X0_ALARM_TH_WRN);
+	alarms |= (status & L6470_STATUS_UVLO) ? 0 : BIT(L64X0_ALARM_UVLO);
+	alarms |= (status & L6470_STATUS_STEP_LOSS_A) ? 0 : BIT(L64X0_ALARM_STEP_LOSS_A);
+	alarms |= (status & L6470_STATUS_STEP_LOSS_B) ? 0 : BIT(L64X0_ALARM_STEP_LOSS_B);
+	alarms |= (status & L6470_STATUS_SW_EVN) ? BIT(L64X0_ALARM_SW_EVN) : 0;
+	alarms |= (status & (L6470_STATUS_WRONG_CMD | L6470_STATUS_NOTPERF_CMD)) ?
+		  BIT(L64X0_ALARM_CMD_ERROR) : 0;
+
+	return alarms;
+}
+
+static uint32_t l6480_alarms(uint16_t status)
+{
+	uint32_t alarms = 0;
+	uint16_t th = status & L6480_STATUS_TH_STATUS(3);
+
+	alarms |= (status & L6480_STATUS_OCD) ? 0 : BIT(L64X0_ALARM_OCD);
+	/* TH_STATUS: 1 warning, 2 bridge shutdown, 3 device shutdown */
+	alarms |= (th == L6480_STATUS_TH_STATUS(1)) ? BIT(L64X0_ALARM_TH_WRN) : 0;
+	alarms |= (th >= L6480_STATUS_TH_STATUS(2)) ? BIT(L64X0_ALARM_TH_SD) : 0;
+	alarms |= (status & L6480_STATUS_UVLO) ? 0 : BIT(L64X0_ALARM_UVLO);
+	alarms |= (status & L6480_STATUS_UVLO_ADC) ? 0 : BIT(L64X0_ALARM_UVLO_ADC);
+	alarms |= (status & L6480_STATUS_STEP_LOSS_A) ? 0 : BIT(L64X0_ALARM_STEP_LOSS_A);
+	alarms |= (status & L6480_STATUS_STEP_LOSS_B) ? 0 : BIT(L64X0_ALARM_STEP_LOSS_B);
+	alarms |= (status & L6480_STATUS_SW_EVN) ? BIT(L64X0_ALARM_SW_EVN) : 0;
+	alarms |= (status & L6480_STATUS_CMD_ERROR) ? BIT(L64X0_ALARM_CMD_ERROR) : 0;
+
+	return alarms;
+}
+
+/* Registers up to ALARM_EN sit at the same address on both chips */
+#define ADDR_SAME(i, _) [i] = i
+BUILD_ASSERT(L64x0_ADDR_ALARM_EN == 23);
+
+static const struct l64x0_variant l6470_variant = {
+        .id = L64X0_VARIANT_L6470,
+        .alarms = l6470_alarms,
+        .bit_len = {
+                [L64x0_ADDR_ABS_POS]    = 22,
+                [L64x0_ADDR_EL_POS]     = 9,
+                [L64x0_ADDR_MARK]       = 22,
+                [L64x0_ADDR_SPEED]      = 20,
+                [L64x0_ADDR_ACC]        = 12,
+                [L64x0_ADDR_DEC]        = 12,
+                [L64x0_ADDR_MAX_SPEED]  = 10,
+                [L64x0_ADDR_MIN_SPEED]  = 13,
+                [L64x0_ADDR_KVAL_HOLD]  = 8,
+                [L64x0_ADDR_KVAL_RUN]   = 8,
+                [L64x0_ADDR_KVAL_ACC]   = 8,
+                [L64x0_ADDR_KVAL_DEC]   = 8,
+                [L64x0_ADDR_INT_SPEED]  = 14,
+                [L64x0_ADDR_ST_SLP]     = 8,
+                [L64x0_ADDR_FN_SLP_ACC] = 8,
+                [L64x0_ADDR_FN_SLP_DEC] = 8,
+                [L64x0_ADDR_K_THERM]    = 4,
+                [L64x0_ADDR_ADC_OUT]    = 5,
+                [L64x0_ADDR_OCD_TH]     = 4,
+                [L64x0_ADDR_STALL_TH]   = 7,
+                [L64x0_ADDR_FS_SPD]     = 10,
+                [L64x0_ADDR_STEP_MODE]  = 8,
+                [L64x0_ADDR_ALARM_EN]   = 8,
+                [L64x0_ADDR_CONFIG]     = 16,
+                [L64x0_ADDR_STATUS]     = 16,
+        },
+        .addr = {
+                LISTIFY(24, ADDR_SAME, (,)),
+                [L64x0_ADDR_CONFIG]     = 0x18,
+                [L64x0_ADDR_STATUS]     = 0x19,
+        },
 };
-#elif IS_ENABLED(CONFIG_L6480)
-static int bit_len[] = {
-        [L64x0_ADDR_ABS_POS]    = 22,
-        [L64x0_ADDR_EL_POS]     = 9,
-        [L64x0_ADDR_MARK]       = 22,
-        [L64x0_ADDR_SPEED]      = 20,
-        [L64x0_ADDR_ACC]        = 12,
-        [L64x0_ADDR_DEC]        = 12,
-        [L64x0_ADDR_MAX_SPEED]  = 10,
-        [L64x0_ADDR_MIN_SPEED]  = 12,
-        [L64x0_ADDR_KVAL_HOLD]  = 8,
-        [L64x0_ADDR_KVAL_RUN]   = 8,
-        [L64x0_ADDR_KVAL_ACC]   = 8,
-        [L64x0_ADDR_KVAL_DEC]   = 8,
-        [L64x0_ADDR_INT_SPEED]  = 14,
-        [L64x0_ADDR_ST_SLP]     = 8,
-        [L64x0_ADDR_FN_SLP_ACC] = 8,
-        [L64x0_ADDR_FN_SLP_DEC] = 8,
-        [L64x0_ADDR_K_THERM]    = 4,
-        [L64x0_ADDR_ADC_OUT]    = 5,
-        [L64x0_ADDR_OCD_TH]     = 5,
-        [L64x0_ADDR_STALL_TH]   = 5,
-        [L64x0_ADDR_FS_SPD]     = 11,
-        [L64x0_ADDR_STEP_MODE]  = 4,
-        [L64x0_ADDR_ALARM_EN]   = 8,
-        [L64x0_ADDR_GATECFG1]   = 11,
-        [L64x0_ADDR_GATECFG2]   = 8,
-        [L64x0_ADDR_CONFIG]     = 16,
-        [L64x0_ADDR_STATUS]     = 16,
+
+static const struct l64x0_variant l6480_variant = {
+        .id = L64X0_VARIANT_L6480,
+        .alarms = l6480_alarms,
+        .bit_len = {
+                [L64x0_ADDR_ABS_POS]    = 22,
+                [L64x0_ADDR_EL_POS]     = 9,
+                [L64x0_ADDR_MARK]       = 22,
+                [L64x0_ADDR_SPEED]      = 20,
+                [L64x0_ADDR_ACC]        = 12,
+                [L64x0_ADDR_DEC]        = 12,
+                [L64x0_ADDR_MAX_SPEED]  = 10,
+                [L64x0_ADDR_MIN_SPEED]  = 13,
+                [L64x0_ADDR_KVAL_HOLD]  = 8,
+                [L64x0_ADDR_KVAL_RUN]   = 8,
+                [L64x0_ADDR_KVAL_ACC]   = 8,
+                [L64x0_ADDR_KVAL_DEC]   = 8,
+                [L64x0_ADDR_INT_SPEED]  = 14,
+                [L64x0_ADDR_ST_SLP]     = 8,
+                [L64x0_ADDR_FN_SLP_ACC] = 8,
+                [L64x0_ADDR_FN_SLP_DEC] = 8,
+                [L64x0_ADDR_K_THERM]    = 4,
+                [L64x0_ADDR_ADC_OUT]    = 5,
+                [L64x0_ADDR_OCD_TH]     = 5,
+                [L64x0_ADDR_STALL_TH]   = 5,
+                [L64x0_ADDR_FS_SPD]     = 11,
+                [L64x0_ADDR_STEP_MODE]  = 8,
+                [L64x0_ADDR_ALARM_EN]   = 8,
+                [L64x0_ADDR_GATECFG1]   = 11,
+                [L64x0_ADDR_GATECFG2]   = 8,
+                [L64x0_ADDR_CONFIG]     = 16,
+                [L64x0_ADDR_STATUS]     = 16,
+        },
+        .addr = {
+                LISTIFY(24, ADDR_SAME, (,)),
+                [L64x0_ADDR_GATECFG1]   = 0x18,
+                [L64x0_ADDR_GATECFG2]   = 0x19,
+                [L64x0_ADDR_CONFIG]     = 0x1a,
+                [L64x0_ADDR_STATUS]     = 0x1b,
+        },
 };
-#endif
 
 #define BITS_TO_BYTES(x) (((x) + 7) >> 3)
 
-static int send_command(const struct device *const dev, uint8_t cmd, int val, int tx_bytes, int rx_bytes)
+/* Registers the chip updates on its own, never served from the shadow */
+#define VOLATILE_REGS							\
+	(BIT(L64x0_ADDR_ABS_POS) | BIT(L64x0_ADDR_EL_POS) |		\
+	 BIT(L64x0_ADDR_MARK) | BIT(L64x0_ADDR_SPEED) |			\
+	 BIT(L64x0_ADDR_ADC_OUT) | BIT(L64x0_ADDR_STATUS))
+
+/* Writes the chip ignores unless the motor is stopped, or in HiZ */
+#define STOPPED_REGS							\
+	(BIT(L64x0_ADDR_ACC) | BIT(L64x0_ADDR_DEC) |			\
+	 BIT(L64x0_ADDR_MIN_SPEED) | BIT(L64x0_ADDR_ALARM_EN))
+#define HIZ_REGS							\
+	(BIT(L64x0_ADDR_INT_SPEED) | BIT(L64x0_ADDR_ST_SLP) |		\
+	 BIT(L64x0_ADDR_FN_SLP_ACC) | BIT(L64x0_ADDR_FN_SLP_DEC) |	\
+	 BIT(L64x0_ADDR_STEP_MODE) | BIT(L64x0_ADDR_GATECFG1) |		\
+	 BIT(L64x0_ADDR_GATECFG2) | BIT(L64x0_ADDR_CONFIG))
+
+BUILD_ASSERT(L64x0_ADDR_LAST <= 32, "register bitmaps are 32 bit wide");
+
+/* STATUS of a locked burst before it is needed, never a 16 bit value */
+#define L64X0_STATUS_UNREAD UINT32_MAX
+
+/* Whether the chip takes a write to param in the motor state of status */
+static inline bool is_writable(uint8_t param, uint32_t status)
+{
+	if ((HIZ_REGS & BIT(param)) && !(status & L64X0_STATUS_HIZ)) {
+		return false;
+	}
+	if ((STOPPED_REGS & BIT(param)) &&
+	    ((status & L64X0_STATUS_MOT_STATUS(3)) || !(status & L64X0_STATUS_BUSY))) {
+		return false;
+	}
+
+	return true;
+}
+
+static inline bool is_valid(const struct device *const dev, uint8_t param)
 {
 	const struct l64x0_config *config = dev->config;
-	const struct spi_dt_spec *spec = &config->spi;
-        uint8_t value;
-        struct spi_buf bufs;
-        struct spi_buf_set bufset;
-        bufset.buffers = &bufs;
-        bufset.count = 1;
-        bufs.buf = &cmd;
-        bufs.len = 1;
-        int ret = 0;
-
-        spi_write_dt(spec, &bufset);
-
-        bufs.buf = &value;
-
-        switch (tx_bytes) {
-        case 0:
-                break;
-        case 1:
-                value = val & 0xff;
-                spi_write_dt(spec, &bufset);
-
-                break;
-        case 2:
-                value = (val >> 8) & 0xff;
-                spi_write_dt(spec, &bufset);
-
-                value = val & 0xff;
-                spi_write_dt(spec, &bufset);
-
-                break;
-        case 3:
-                value = (val >> 16) & 0xff;
-                spi_write_dt(spec, &bufset);
-
-                value = (val >> 8) & 0xff;
-                spi_write_dt(spec, &bufset);
-
-                value = val & 0xff;
-                spi_write_dt(spec, &bufset);
-
-                break;
-        default:
-                break;
-        }
-
-        switch (rx_bytes) {
-        case 0:
-                break;
-        case 1:
-                /* FIXME: this breaks SPI communication */
-                //k_busy_wait(10);
-                spi_read_dt(spec, &bufset);
-                ret = value;
-
-                break;
-        case 2:
-                spi_read_dt(spec, &bufset);
-                ret |= value << 8;
-
-                spi_read_dt(spec, &bufset);
-                ret |= value;
-
-                break;
-        case 3:
-                spi_read_dt(spec, &bufset);
-                ret |= value << 16;
-
-                spi_read_dt(spec, &bufset);
-                ret |= value << 8;
-
-                spi_read_dt(spec, &bufset);
-                ret |= value;
-
-                break;
-        default:
-                LOG_WRN("rx_bytes is %d for cmd %x", rx_bytes, cmd);
-                ret = -1;
-
-                break;
-        }
-
-        return ret;
+
+	return param > 0 && param < L64x0_ADDR_LAST && config->variant->bit_len[param] > 0;
 }
 
-static int send_command_simple(const struct device *const dev, uint8_t cmd)
+static inline bool is_cached(uint8_t param)
 {
-        return send_command(dev, cmd, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+	return !(VOLATILE_REGS & BIT(param));
 }
 
-int l64x0_nop(const struct device *const dev)
+/* Slot of a device in the per-byte frame: the first byte shifted out reaches the last chip */
+#define BUS_SLOT(bus, config) ((bus)->length - 1 - (config)->position)
+
+static void l64x0_cmd_prepare(struct l64x0_cmd *cmd, const struct device *const dev,
+			      uint8_t opcode, uint32_t val, int tx_bytes, int rx_bytes)
 {
-        return send_command_simple(dev, CMD_NOP);
+	cmd->dev = dev;
+	cmd->len = 1 + MAX(tx_bytes, rx_bytes);
+	cmd->read = rx_bytes > 0;
+
+	memset(cmd->tx, CMD_NOP, sizeof(cmd->tx));
+	cmd->tx[0] = opcode;
+	for (int i = 0; i < tx_bytes; i++) {
+		cmd->tx[tx_bytes - i] = (val >> (8 * i)) & 0xff;
+	}
+}
+
+int l64x0_cmd_result(const struct l64x0_cmd *cmd)
+{
+	int ret = 0;
+
+	if (!cmd->read) {
+		return 0;
+	}
+
+	for (int i = 1; i < cmd->len; i++) {
+		ret = (ret << 8) | cmd->rx[i];
+	}
+
+	return ret;
+}
+
+static void l64x0_bus_cs_gap(const struct l64x0_bus *bus)
+{
+	while (k_cycle_get_32() - bus->cs_high_start < bus->cs_high_cycles) {
+		/* The chip latches a byte on the CS rising edge */
+		if (IS_ENABLED(CONFIG_ARCH_POSIX)) {
+			/* Simulated time only moves when waited on */
+			k_busy_wait(1);
+		}
+	}
 }
 
-void l64x0_setparam(const struct device *const dev, uint8_t param, uint32_t val)
+/* Hand the controller to a chip select, releasing the previous one */
+static void l64x0_ctrl_own(struct l64x0_bus *bus)
 {
-        int tx_bytes;
+	struct l64x0_ctrl *ctrl = bus->ctrl;
 
-        if (param == 0 || L64x0_ADDR_LAST <= param) {
-                LOG_ERR("param = %x", param);
-                return;
-        }
+	if (ctrl->owner != bus) {
+		if (ctrl->owner != NULL) {
+			spi_release_dt(&ctrl->owner->spi);
+		}
+		ctrl->owner = bus;
+	}
+}
 
-        tx_bytes = BITS_TO_BYTES(bit_len[param]);
+static void l64x0_ctrl_disown(struct l64x0_ctrl *ctrl)
+{
+	if (ctrl->owner != NULL) {
+		spi_release_dt(&ctrl->owner->spi);
+		ctrl->owner = NULL;
+	}
+}
 
-        send_command(dev, param, val, tx_bytes, RX_BYTES_NONE);
+/*
+ * Each byte time shifts one byte per chip of the chain; chips without a
+ * command get NOPs. Shorter commands are padded with leading NOPs so that
+ * every command of the frame completes on the same, last, CS rising edge.
+ */
+static inline int l64x0_bus_cmd_byte(const struct l64x0_bus *bus, const struct l64x0_cmd *cmd)
+{
+	return (cmd != NULL) ? bus->byte - (bus->frames - cmd->len) : -1;
 }
 
-int l64x0_getparam(const struct device *const dev, uint8_t param)
+static void l64x0_bus_load_byte(struct l64x0_bus *bus)
 {
-        int rx_bytes;
+	for (uint8_t slot = 0; slot < bus->length; slot++) {
+		const struct l64x0_cmd *cmd = bus->inflight[slot];
+		int i = l64x0_bus_cmd_byte(bus, cmd);
 
-        if (param == 0 || L64x0_ADDR_LAST <= param) {
-                LOG_ERR("param = %x", param);
-                return -EINVAL;
-        }
+		bus->tx[slot] = (i >= 0) ? cmd->tx[i] : CMD_NOP;
+	}
+}
 
-        rx_bytes = BITS_TO_BYTES(bit_len[param]);
+static void l64x0_bus_store_byte(struct l64x0_bus *bus)
+{
+	for (uint8_t slot = 0; slot < bus->length; slot++) {
+		struct l64x0_cmd *cmd = bus->inflight[slot];
+		int i = l64x0_bus_cmd_byte(bus, cmd);
 
-        return send_command(dev, CMD_GET_PARAM | param, 0, TX_BYTES_NONE, rx_bytes);
+		if (i >= 0) {
+			cmd->rx[i] = bus->rx[slot];
+		}
+	}
 }
 
-int l64x0_run(const struct device *const dev, int speed)
+#ifdef CONFIG_L64X0_ASYNC
+static void l64x0_bus_async_cb(const struct device *spi, int result, void *user_data);
+
+static int l64x0_bus_async_start_byte(struct l64x0_bus *bus)
 {
-        bool dir = speed >= 0;
+	l64x0_bus_load_byte(bus);
+	l64x0_bus_cs_gap(bus);
 
-	return send_command(dev, CMD_RUN | dir, abs(speed), TX_BYTES_RUN, RX_BYTES_NONE);
+	return spi_transceive_cb(bus->spi.bus, &bus->spi.config, &bus->tx_set, &bus->rx_set,
+				 l64x0_bus_async_cb, bus);
 }
 
-int l64x0_move(const struct device *const dev, int n_step)
+static void l64x0_bus_async_complete(struct l64x0_bus *bus, int status)
 {
-        bool dir = n_step >= 0;
+	for (uint8_t slot = 0; slot < bus->length; slot++) {
+		struct l64x0_cmd *cmd = bus->inflight[slot];
 
-        send_command(dev, CMD_MOVE | dir, abs(n_step), TX_BYTES_MOVE, RX_BYTES_NONE);
+		if (cmd == NULL) {
+			continue;
+		}
 
-        return 0;
+		bus->inflight[slot] = NULL;
+		if (cmd->cb != NULL) {
+			cmd->cb(cmd->dev, cmd, status, cmd->user_data);
+		}
+	}
 }
 
-int l64x0_reset_device(const struct device *const dev)
+/* Take the oldest pending command of every chip into one frame, controller locked */
+static void l64x0_bus_async_load(struct l64x0_bus *bus)
 {
-        return send_command_simple(dev, CMD_RESET_DEVICE);
+	bus->byte = 0;
+	bus->frames = 0;
+	for (uint8_t slot = 0; slot < bus->length; slot++) {
+		sys_snode_t *node = sys_slist_get(&bus->queues[slot]);
+
+		if (node != NULL) {
+			bus->inflight[slot] = CONTAINER_OF(node, struct l64x0_cmd, node);
+			bus->frames = MAX(bus->frames, bus->inflight[slot]->len);
+		}
+	}
 }
 
-int l64x0_soft_stop(const struct device *const dev)
+static bool l64x0_bus_async_pending(struct l64x0_bus *bus)
 {
-        return send_command_simple(dev, CMD_SOFT_STOP);
+	for (uint8_t slot = 0; slot < bus->length; slot++) {
+		if (!sys_slist_is_empty(&bus->queues[slot])) {
+			return true;
+		}
+	}
+
+	return false;
 }
 
-int l64x0_hard_stop(const struct device *const dev)
+/* Next chip select with pending commands, after the current one */
+static struct l64x0_bus *l64x0_ctrl_async_pick(struct l64x0_ctrl *ctrl)
 {
-        return send_command_simple(dev, CMD_HARD_STOP);
+	struct l64x0_bus *bus;
+	bool after = (ctrl->cur == NULL);
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&ctrl->buses, bus, ctrl_node) {
+		if (after && l64x0_bus_async_pending(bus)) {
+			return bus;
+		}
+		after = after || (bus == ctrl->cur);
+	}
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&ctrl->buses, bus, ctrl_node) {
+		if (l64x0_bus_async_pending(bus)) {
+			return bus;
+		}
+		if (bus == ctrl->cur) {
+			break;
+		}
+	}
+
+	return NULL;
 }
 
-int l64x0_soft_hiz(const struct device *const dev)
+/*
+ * Hands controllers over between chip selects. Blocking callers of the
+ * driver run on the system work queue, so the handover cannot.
+ */
+static struct k_work_q l64x0_kick_q;
+static K_KERNEL_STACK_DEFINE(l64x0_kick_q_stack, CONFIG_L64X0_ASYNC_STACK_SIZE);
+
+/*
+ * Start the next frame, one chip select after the other, or release the
+ * controller once nothing is pending. This also runs from the SPI
+ * completion interrupt, where the controller can only go on with the
+ * chip select holding it; handing it over is left to a thread.
+ */
+static void l64x0_ctrl_async_next(struct l64x0_ctrl *ctrl)
 {
-        return send_command_simple(dev, CMD_SOFT_HIZ);
+	struct l64x0_bus *bus;
+	k_spinlock_key_t key;
+	int ret;
+
+	for (;;) {
+		key = k_spin_lock(&ctrl->lock);
+		bus = l64x0_ctrl_async_pick(ctrl);
+		if (bus == NULL) {
+			k_spin_unlock(&ctrl->lock, key);
+			break;
+		}
+		if (bus != ctrl->owner && k_is_in_isr()) {
+			k_spin_unlock(&ctrl->lock, key);
+			k_work_submit_to_queue(&l64x0_kick_q, &ctrl->kick);
+			return;
+		}
+		ctrl->cur = bus;
+		l64x0_bus_async_load(bus);
+		k_spin_unlock(&ctrl->lock, key);
+
+		l64x0_ctrl_own(bus);
+		ret = l64x0_bus_async_start_byte(bus);
+		if (ret == 0) {
+			return;
+		}
+
+		LOG_ERR("SPI transfer failed (%d)", ret);
+		l64x0_bus_async_complete(bus, ret);
+	}
+
+	l64x0_ctrl_disown(ctrl);
+
+	key = k_spin_lock(&ctrl->lock);
+	ctrl->busy = (l64x0_ctrl_async_pick(ctrl) != NULL);
+	k_spin_unlock(&ctrl->lock, key);
+
+	if (ctrl->busy) {
+		/* A submission raced with the release, restart from a thread */
+		k_work_submit_to_queue(&l64x0_kick_q, &ctrl->kick);
+	}
 }
 
-int l64x0_hard_hiz(const struct device *const dev)
+static void l64x0_bus_async_cb(const struct device *spi, int result, void *user_data)
 {
-        return send_command_simple(dev, CMD_HARD_HIZ);
+	struct l64x0_bus *bus = user_data;
+
+	bus->cs_high_start = k_cycle_get_32();
+
+	if (result == 0) {
+		l64x0_bus_store_byte(bus);
+
+		if (++bus->byte < bus->frames) {
+			result = l64x0_bus_async_start_byte(bus);
+			if (result == 0) {
+				return;
+			}
+		}
+	}
+
+	if (result < 0) {
+		LOG_ERR("SPI transfer failed (%d)", result);
+	}
+
+	l64x0_bus_async_complete(bus, result);
+	l64x0_ctrl_async_next(bus->ctrl);
 }
 
-int l64x0_get_status(const struct device *const dev)
+static void l64x0_ctrl_async_kick(struct k_work *work)
 {
-        return send_command(dev, CMD_GET_STATUS, 0, TX_BYTES_NONE, RX_BYTES_GET_STATUS);
+	struct l64x0_ctrl *ctrl = CONTAINER_OF(work, struct l64x0_ctrl, kick);
+
+	l64x0_ctrl_async_next(ctrl);
 }
 
-int l64x0_init(const struct device *dev)
+static void l64x0_bus_async_enqueue(struct l64x0_bus *bus, struct l64x0_cmd *cmds, size_t n)
+{
+	struct l64x0_ctrl *ctrl = bus->ctrl;
+	k_spinlock_key_t key = k_spin_lock(&ctrl->lock);
+	bool idle = !ctrl->busy;
+
+	for (size_t i = 0; i < n; i++) {
+		const struct l64x0_config *config = cmds[i].dev->config;
+
+		sys_slist_append(&bus->queues[BUS_SLOT(bus, config)], &cmds[i].node);
+	}
+	ctrl->busy = true;
+
+	k_spin_unlock(&ctrl->lock, key);
+
+	if (!idle) {
+		return;
+	}
+
+	/* Locking the controller may block, which an ISR cannot do */
+	if (k_is_in_isr()) {
+		k_work_submit_to_queue(&l64x0_kick_q, &ctrl->kick);
+	} else {
+		l64x0_ctrl_async_next(ctrl);
+	}
+}
+
+struct l64x0_waiter {
+	struct k_sem done;
+	int status;
+};
+
+static void l64x0_waiter_cb(const struct device *dev, struct l64x0_cmd *cmd, int status,
+			    void *user_data)
 {
+	struct l64x0_waiter *waiter = user_data;
+
+	if (status < 0) {
+		waiter->status = status;
+	}
+	k_sem_give(&waiter->done);
+}
+
+/* Blocking submission on top of the queues */
+static int l64x0_bus_xfer(struct l64x0_bus *bus, struct l64x0_cmd *cmds, size_t n)
+{
+	struct l64x0_waiter waiter = { .status = 0 };
+
+	k_sem_init(&waiter.done, 0, n);
+
+	for (size_t i = 0; i < n; i++) {
+		cmds[i].cb = l64x0_waiter_cb;
+		cmds[i].user_data = &waiter;
+	}
+
+	l64x0_bus_async_enqueue(bus, cmds, n);
+
+	for (size_t i = 0; i < n; i++) {
+		k_sem_take(&waiter.done, K_FOREVER);
+	}
+
+	return waiter.status;
+}
+
+int l64x0_submit(struct l64x0_cmd *cmd, l64x0_callback_t cb, void *user_data)
+{
+	const struct l64x0_config *config = cmd->dev->config;
+
+	cmd->cb = cb;
+	cmd->user_data = user_data;
+
+	l64x0_bus_async_enqueue(config->bus, cmd, 1);
+
 	return 0;
 }
+#else
+/* Put the commands aimed at this chip select in flight, bus lock held */
+static void l64x0_bus_frame_begin(struct l64x0_bus *bus, struct l64x0_cmd *cmds, size_t n)
+{
+	bus->byte = 0;
+	bus->frames = 0;
+	for (size_t i = 0; i < n; i++) {
+		const struct l64x0_config *config = cmds[i].dev->config;
+
+		if (config->bus != bus) {
+			continue;
+		}
+
+		bus->inflight[BUS_SLOT(bus, config)] = &cmds[i];
+		bus->frames = MAX(bus->frames, cmds[i].len);
+	}
+}
 
-#define L64X0_INIT(n)							\
-	static const struct l64x0_config l64x0_cfg_##n = {		\
-		.spi = SPI_DT_SPEC_INST_GET(n,				\
-					    SPI_OP_MODE_MASTER |	\
-					    SPI_MODE_CPOL |		\
-					    SPI_MODE_CPHA |		\
-					    SPI_TRANSFER_MSB |		\
-					    SPI_WORD_SET(8) |		\
-					    SPI_LOCK_ON,		\
-					    0),				\
-	};								\
-									\
-	DEVICE_DT_INST_DEFINE(n,					\
-			      &l64x0_init,				\
-			      NULL,					\
-			      NULL,					\
-			      &l64x0_cfg_##n,				\
-			      POST_KERNEL,				\
-			      CONFIG_L64X0_INIT_PRIORITY,		\
-			      NULL);
+/* Clock the frame in flight up to, not including, byte time end */
+static int l64x0_bus_clock(struct l64x0_bus *bus, uint8_t end)
+{
+	int ret;
+
+	for (; bus->byte < end; bus->byte++) {
+		l64x0_bus_load_byte(bus);
+		l64x0_bus_cs_gap(bus);
+		l64x0_ctrl_own(bus);
+
+		ret = spi_transceive_dt(&bus->spi, &bus->tx_set, &bus->rx_set);
+		bus->cs_high_start = k_cycle_get_32();
+		if (ret < 0) {
+			LOG_ERR("SPI transfer failed (%d)", ret);
+			return ret;
+		}
+
+		l64x0_bus_store_byte(bus);
+	}
+
+	return 0;
+}
+
+static void l64x0_bus_frame_end(struct l64x0_bus *bus)
+{
+	memset(bus->inflight, 0, bus->length * sizeof(bus->inflight[0]));
+}
+
+/*
+ * Clock a set of commands through one chip select, controller held. It
+ * stays locked after the frame so that a burst of frames costs a single
+ * bus acquisition; l64x0_ctrl_release() ends the burst.
+ */
+static int l64x0_bus_xfer_locked(struct l64x0_bus *bus, struct l64x0_cmd *cmds, size_t n)
+{
+	int ret;
+
+	l64x0_bus_frame_begin(bus, cmds, n);
+	ret = l64x0_bus_clock(bus, bus->frames);
+	l64x0_bus_frame_end(bus);
+
+	return ret;
+}
+
+/* Commands of all chip selects of a controller go out one at a time */
+static void l64x0_ctrl_acquire(struct l64x0_ctrl *ctrl)
+{
+	k_mutex_lock(&ctrl->lock, K_FOREVER);
+}
+
+static void l64x0_ctrl_release(struct l64x0_ctrl *ctrl)
+{
+	l64x0_ctrl_disown(ctrl);
+	k_mutex_unlock(&ctrl->lock);
+}
+
+static int l64x0_bus_xfer(struct l64x0_bus *bus, struct l64x0_cmd *cmds, size_t n)
+{
+	int ret;
+
+	l64x0_ctrl_acquire(bus->ctrl);
+	ret = l64x0_bus_xfer_locked(bus, cmds, n);
+	l64x0_ctrl_release(bus->ctrl);
+
+	return ret;
+}
+#endif /* CONFIG_L64X0_ASYNC */
+
+int l64x0_chain_submit(struct l64x0_cmd *cmds, size_t n)
+{
+	struct l64x0_bus *bus;
+	uint32_t used = 0;
+
+	if (n == 0) {
+		return 0;
+	}
+
+	bus = ((const struct l64x0_config *)cmds[0].dev->config)->bus;
+
+	for (size_t i = 0; i < n; i++) {
+		const struct l64x0_config *config = cmds[i].dev->config;
+
+		if (config->bus != bus || (used & BIT(config->position))) {
+			LOG_ERR("commands must target distinct chips of one chain");
+			return -EINVAL;
+		}
+		used |= BIT(config->position);
+	}
+
+	return l64x0_bus_xfer(bus, cmds, n);
+}
+
+#define CMD_BUS(cmd) (((const struct l64x0_config *)(cmd)->dev->config)->bus)
+
+#ifndef CONFIG_L64X0_ASYNC
+/* Serializes groups, which hold several buses at once */
+static K_MUTEX_DEFINE(l64x0_group_lock);
+
+/* True for the first command aimed at its chip select */
+static bool l64x0_group_bus_first(struct l64x0_cmd *cmds, size_t i)
+{
+	for (size_t j = 0; j < i; j++) {
+		if (CMD_BUS(&cmds[j]) == CMD_BUS(&cmds[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* True for the first command aimed at its controller */
+static bool l64x0_group_ctrl_first(struct l64x0_cmd *cmds, size_t i)
+{
+	for (size_t j = 0; j < i; j++) {
+		if (CMD_BUS(&cmds[j])->ctrl == CMD_BUS(&cmds[i])->ctrl) {
+			return false;
+		}
+	}
+
+	return true;
+}
+#endif
+
+static bool l64x0_cmds_distinct(struct l64x0_cmd *cmds, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < i; j++) {
+			if (cmds[j].dev == cmds[i].dev) {
+				LOG_ERR("one command per device in a group");
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int l64x0_group_submit(struct l64x0_cmd *cmds, size_t n, uint32_t *skew_ns)
+{
+#ifndef CONFIG_L64X0_ASYNC
+	uint32_t first = 0, last = 0;
+	int ret = 0;
+#endif
+
+	if (!l64x0_cmds_distinct(cmds, n)) {
+		return -EINVAL;
+	}
+
+	if (skew_ns != NULL) {
+		*skew_ns = 0;
+	}
+
+	if (n == 0) {
+		return 0;
+	}
+
+#ifdef CONFIG_L64X0_ASYNC
+	/* The queues own the controllers, only a single frame can be promised */
+	for (size_t i = 1; i < n; i++) {
+		if (CMD_BUS(&cmds[i]) != CMD_BUS(&cmds[0])) {
+			LOG_ERR("groups across chip selects need CONFIG_L64X0_ASYNC=n");
+			return -ENOTSUP;
+		}
+	}
+
+	return l64x0_bus_xfer(CMD_BUS(&cmds[0]), cmds, n);
+#else
+	k_mutex_lock(&l64x0_group_lock, K_FOREVER);
+
+	for (size_t i = 0; i < n; i++) {
+		if (l64x0_group_ctrl_first(cmds, i)) {
+			l64x0_ctrl_acquire(CMD_BUS(&cmds[i])->ctrl);
+		}
+		if (l64x0_group_bus_first(cmds, i)) {
+			l64x0_bus_frame_begin(CMD_BUS(&cmds[i]), cmds, n);
+		}
+	}
+
+	/* Stage everything but the byte time that makes the commands execute */
+	for (size_t i = 0; i < n && ret == 0; i++) {
+		if (l64x0_group_bus_first(cmds, i)) {
+			struct l64x0_bus *bus = CMD_BUS(&cmds[i]);
+
+			ret = l64x0_bus_clock(bus, bus->frames - 1);
+		}
+	}
+
+	/* Then the last byte times, back to back */
+	for (size_t i = 0; i < n && ret == 0; i++) {
+		if (l64x0_group_bus_first(cmds, i)) {
+			struct l64x0_bus *bus = CMD_BUS(&cmds[i]);
+
+			ret = l64x0_bus_clock(bus, bus->frames);
+			last = bus->cs_high_start;
+			if (i == 0) {
+				first = last;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (l64x0_group_bus_first(cmds, i)) {
+			l64x0_bus_frame_end(CMD_BUS(&cmds[i]));
+		}
+		if (l64x0_group_ctrl_first(cmds, i)) {
+			l64x0_ctrl_release(CMD_BUS(&cmds[i])->ctrl);
+		}
+	}
+
+	k_mutex_unlock(&l64x0_group_lock);
+
+	if (ret == 0 && skew_ns != NULL) {
+		*skew_ns = k_cyc_to_ns_ceil32(last - first);
+	}
+
+	return ret;
+#endif
+}
+
+#ifndef CONFIG_L64X0_ASYNC
+/* Send the share of one controller, a frame per chip select */
+static int l64x0_fanout_ctrl(struct l64x0_ctrl *ctrl, struct l64x0_cmd *cmds, size_t n)
+{
+	int ret = 0;
+
+	l64x0_ctrl_acquire(ctrl);
+
+	for (size_t i = 0; i < n && ret == 0; i++) {
+		if (CMD_BUS(&cmds[i])->ctrl == ctrl && l64x0_group_bus_first(cmds, i)) {
+			ret = l64x0_bus_xfer_locked(CMD_BUS(&cmds[i]), cmds, n);
+		}
+	}
+
+	l64x0_ctrl_release(ctrl);
+
+	return ret;
+}
+#endif
+
+#ifdef CONFIG_L64X0_FANOUT
+struct l64x0_fanout_job {
+	struct k_work work;
+	struct l64x0_ctrl *ctrl;
+	struct l64x0_cmd *cmds;
+	size_t n;
+	struct k_sem *done;
+	int ret;
+};
+
+static void l64x0_fanout_work(struct k_work *work)
+{
+	struct l64x0_fanout_job *job = CONTAINER_OF(work, struct l64x0_fanout_job, work);
+
+	job->ret = l64x0_fanout_ctrl(job->ctrl, job->cmds, job->n);
+	k_sem_give(job->done);
+}
+#endif
+
+int l64x0_fanout(struct l64x0_cmd *cmds, size_t n)
+{
+#ifdef CONFIG_L64X0_ASYNC
+	struct l64x0_waiter waiter = { .status = 0 };
+#else
+#ifdef CONFIG_L64X0_FANOUT
+	struct l64x0_fanout_job jobs[CONFIG_L64X0_FANOUT_CONTROLLERS];
+	struct k_sem done;
+	size_t queued = 0;
+#endif
+	int ret = 0;
+	int err;
+#endif
+
+	if (!l64x0_cmds_distinct(cmds, n)) {
+		return -EINVAL;
+	}
+
+#ifdef CONFIG_L64X0_ASYNC
+	/* Each controller runs from its own completion interrupt already */
+	k_sem_init(&waiter.done, 0, n);
+
+	for (size_t i = 0; i < n; i++) {
+		cmds[i].cb = l64x0_waiter_cb;
+		cmds[i].user_data = &waiter;
+		l64x0_bus_async_enqueue(CMD_BUS(&cmds[i]), &cmds[i], 1);
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		k_sem_take(&waiter.done, K_FOREVER);
+	}
+
+	return waiter.status;
+#else
+#ifdef CONFIG_L64X0_FANOUT
+	k_sem_init(&done, 0, ARRAY_SIZE(jobs));
+
+	for (size_t i = 0; i < n; i++) {
+		struct l64x0_ctrl *ctrl = CMD_BUS(&cmds[i])->ctrl;
+
+		if (l64x0_group_ctrl_first(cmds, i) && ctrl->workq != NULL) {
+			struct l64x0_fanout_job *job = &jobs[queued++];
+
+			k_work_init(&job->work, l64x0_fanout_work);
+			job->ctrl = ctrl;
+			job->cmds = cmds;
+			job->n = n;
+			job->done = &done;
+			k_work_submit_to_queue(ctrl->workq, &job->work);
+		}
+	}
+#endif
+
+	/* Controllers without a worker, from this thread meanwhile */
+	for (size_t i = 0; i < n; i++) {
+		struct l64x0_ctrl *ctrl = CMD_BUS(&cmds[i])->ctrl;
+
+		if (!l64x0_group_ctrl_first(cmds, i)) {
+			continue;
+		}
+#ifdef CONFIG_L64X0_FANOUT
+		if (ctrl->workq != NULL) {
+			continue;
+		}
+#endif
+		err = l64x0_fanout_ctrl(ctrl, cmds, n);
+		if (ret == 0) {
+			ret = err;
+		}
+	}
+
+#ifdef CONFIG_L64X0_FANOUT
+	for (size_t i = 0; i < queued; i++) {
+		k_sem_take(&done, K_FOREVER);
+	}
+
+	for (size_t i = 0; i < queued && ret == 0; i++) {
+		ret = jobs[i].ret;
+	}
+#endif
+
+	return ret;
+#endif
+}
+
+/*
+ * Hold a device for a burst of commands. Without async support the bus
+ * is held as well, so the whole burst goes out without interleaving.
+ */
+static void l64x0_lock(const struct device *const dev)
+{
+	struct l64x0_data *data = dev->data;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+#ifndef CONFIG_L64X0_ASYNC
+	l64x0_ctrl_acquire(((const struct l64x0_config *)dev->config)->bus->ctrl);
+#endif
+}
+
+static void l64x0_unlock(const struct device *const dev)
+{
+	struct l64x0_data *data = dev->data;
+
+#ifndef CONFIG_L64X0_ASYNC
+	l64x0_ctrl_release(((const struct l64x0_config *)dev->config)->bus->ctrl);
+#endif
+	k_mutex_unlock(&data->lock);
+}
+
+static int l64x0_recover_locked(const struct device *const dev);
+
+#ifdef CONFIG_L64X0_STATS
+static enum l64x0_op l64x0_stats_op(uint8_t cmd)
+{
+	switch (cmd & (7 << 5)) {
+	case CMD_SET_PARAM:
+		return (cmd == CMD_NOP) ? L64X0_OP_NOP : L64X0_OP_SET_PARAM;
+	case CMD_GET_PARAM:
+		return L64X0_OP_GET_PARAM;
+	case CMD_GO_UNTIL & (7 << 5):
+		return (cmd & BIT(4)) ? L64X0_OP_RELEASE_SW : L64X0_OP_GO_UNTIL;
+	}
+
+	switch (cmd & ~BIT(0)) {
+	case CMD_MOVE:
+		return L64X0_OP_MOVE;
+	case CMD_RUN:
+		return L64X0_OP_RUN;
+	case CMD_STEP_CLOCK:
+		return L64X0_OP_STEP_CLOCK;
+	case CMD_GOTO:
+		return L64X0_OP_GOTO;
+	case CMD_GOTO_DIR:
+		return L64X0_OP_GOTO_DIR;
+	case CMD_GO_HOME:
+		return L64X0_OP_GO_HOME;
+	case CMD_GO_MARK:
+		return L64X0_OP_GO_MARK;
+	case CMD_SOFT_HIZ:
+		return L64X0_OP_SOFT_HIZ;
+	case CMD_HARD_HIZ:
+		return L64X0_OP_HARD_HIZ;
+	case CMD_SOFT_STOP:
+		return L64X0_OP_SOFT_STOP;
+	case CMD_HARD_STOP:
+		return L64X0_OP_HARD_STOP;
+	case CMD_RESET_DEVICE:
+		return L64X0_OP_RESET_DEVICE;
+	case CMD_GET_STATUS:
+		return L64X0_OP_GET_STATUS;
+	default:
+		return L64X0_OP_RESET_POS;
+	}
+}
+
+/* Account one command, device held */
+static void l64x0_stats_record(struct l64x0_data *data, uint8_t cmd, uint8_t len,
+			       uint32_t cycles)
+{
+	struct l64x0_op_stats *stats = &data->stats[l64x0_stats_op(cmd)];
+	uint8_t bucket = (cycles > 0) ? LOG2(cycles) : 0;
+
+	if (stats->count == 0 || cycles < stats->min_cycles) {
+		stats->min_cycles = cycles;
+	}
+	stats->max_cycles = MAX(stats->max_cycles, cycles);
+	stats->count++;
+	stats->bytes += len;
+	stats->total_cycles += cycles;
+	stats->hist[MIN(bucket, CONFIG_L64X0_STATS_HIST_BUCKETS - 1)]++;
+}
+#endif /* CONFIG_L64X0_STATS */
+
+/*
+ * Encode a command into the device's frame and submit it, device held.
+ * Returns what the chip shifted out, at most 24 bits, or a negative errno.
+ */
+static int send_command_locked(const struct device *const dev, uint8_t cmd, int val,
+			       int tx_bytes, int rx_bytes)
+{
+	struct l64x0_data *data = dev->data;
+	const struct l64x0_config *config = dev->config;
+	int ret;
+
+	if (rx_bytes >= L64X0_CMD_MAX_BYTES || tx_bytes >= L64X0_CMD_MAX_BYTES) {
+		LOG_WRN("rx_bytes is %d, tx_bytes is %d for cmd %x", rx_bytes, tx_bytes, cmd);
+		return -EINVAL;
+	}
+
+	l64x0_cmd_prepare(&data->frame, dev, cmd, val, tx_bytes, rx_bytes);
+
+#ifdef CONFIG_L64X0_STATS
+	uint32_t start = k_cycle_get_32();
+#endif
+#ifdef CONFIG_L64X0_ASYNC
+	ret = l64x0_bus_xfer(config->bus, &data->frame, 1);
+#else
+	ret = l64x0_bus_xfer_locked(config->bus, &data->frame, 1);
+#endif
+#ifdef CONFIG_L64X0_STATS
+	l64x0_stats_record(data, cmd, data->frame.len, k_cycle_get_32() - start);
+#endif
+	if (ret < 0) {
+		data->errors.bus++;
+		/* The chip may hold half a command, whatever happens to this one */
+		if (!data->recovering) {
+			l64x0_recover_locked(dev);
+		}
+		return ret;
+	}
+
+	return l64x0_cmd_result(&data->frame);
+}
+
+static int send_command(const struct device *const dev, uint8_t cmd, int val, int tx_bytes, int rx_bytes)
+{
+	int ret;
+
+	l64x0_lock(dev);
+	ret = send_command_locked(dev, cmd, val, tx_bytes, rx_bytes);
+	l64x0_unlock(dev);
+
+	return ret;
+}
+
+static int send_command_simple(const struct device *const dev, uint8_t cmd)
+{
+        return send_command(dev, cmd, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+int l64x0_nop(const struct device *const dev)
+{
+        return send_command_simple(dev, CMD_NOP);
+}
+
+/*
+ * Write a register through the shadow, device held. STATUS is read into
+ * *status the first time a burst writes a register the chip only takes in
+ * some motor states, and the write is refused with -EBUSY if the chip
+ * would ignore it. Accepted ones stay dirty until read back.
+ */
+static int l64x0_setparam_locked(const struct device *const dev, uint8_t param, uint32_t val,
+				 uint32_t *status)
+{
+	const struct l64x0_config *config = dev->config;
+	const struct l64x0_variant *variant = config->variant;
+	struct l64x0_data *data = dev->data;
+	int tx_bytes = BITS_TO_BYTES(variant->bit_len[param]);
+	uint8_t cmd = CMD_SET_PARAM | variant->addr[param];
+	int ret;
+
+	val &= GENMASK(variant->bit_len[param] - 1, 0);
+
+	if (!is_cached(param)) {
+		return send_command_locked(dev, cmd, val, tx_bytes, RX_BYTES_NONE);
+	}
+
+	if (!atomic_test_bit(&data->dirty, param) && data->shadow[param] == val) {
+		return 0;
+	}
+
+	if ((STOPPED_REGS | HIZ_REGS) & BIT(param)) {
+		if (*status == L64X0_STATUS_UNREAD) {
+			ret = send_command_locked(dev, CMD_GET_PARAM |
+						  variant->addr[L64x0_ADDR_STATUS], 0,
+						  TX_BYTES_NONE, RX_BYTES_GET_STATUS);
+			if (ret < 0) {
+				return ret;
+			}
+			*status = ret;
+		}
+		if (!is_writable(param, *status)) {
+			return -EBUSY;
+		}
+	}
+
+	atomic_set_bit(&data->dirty, param);
+	data->shadow[param] = val;
+	data->known |= BIT(param);
+
+	ret = send_command_locked(dev, cmd, val, tx_bytes, RX_BYTES_NONE);
+	/* STATUS may be stale by now, those are trusted once read back */
+	if (ret == 0 && !((STOPPED_REGS | HIZ_REGS) & BIT(param))) {
+		atomic_clear_bit(&data->dirty, param);
+	}
+
+	return ret;
+}
+
+/* Read a register through the shadow, device held */
+static int l64x0_getparam_locked(const struct device *const dev, uint8_t param, uint32_t *val)
+{
+	const struct l64x0_config *config = dev->config;
+	const struct l64x0_variant *variant = config->variant;
+	struct l64x0_data *data = dev->data;
+	int rx_bytes = BITS_TO_BYTES(variant->bit_len[param]);
+	int ret;
+
+	if (is_cached(param) && !atomic_test_bit(&data->dirty, param)) {
+		*val = data->shadow[param];
+		return 0;
+	}
+
+	ret = send_command_locked(dev, CMD_GET_PARAM | variant->addr[param], 0,
+				  TX_BYTES_NONE, rx_bytes);
+	if (ret < 0) {
+		return ret;
+	}
+
+	*val = ret & GENMASK(variant->bit_len[param] - 1, 0);
+	if (is_cached(param)) {
+		data->shadow[param] = *val;
+		data->known |= BIT(param);
+		atomic_clear_bit(&data->dirty, param);
+	}
+
+	return 0;
+}
+
+/*
+ * Rewrite the registers the shadow knows, as one burst, skipping those the
+ * chip would refuse in the motor state of status. They stay dirty, so they
+ * are read back from the chip before being trusted again.
+ */
+static int l64x0_restore_locked(const struct device *const dev, uint32_t status)
+{
+	struct l64x0_data *data = dev->data;
+	int ret = 0;
+
+	atomic_or(&data->dirty, data->known);
+
+	for (uint8_t param = 1; param < L64x0_ADDR_LAST && ret == 0; param++) {
+		if ((data->known & BIT(param)) && is_writable(param, status)) {
+			ret = l64x0_setparam_locked(dev, param, data->shadow[param], &status);
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Flush a partial command with NOPs, then check and clear the latched
+ * flags and rewrite every register the flushed command may have hit.
+ */
+static int l64x0_recover_locked(const struct device *const dev)
+{
+	struct l64x0_data *data = dev->data;
+	uint32_t alarms;
+	int ret = 0;
+
+	data->recovering = true;
+
+	/* A command waiting for its argument takes the NOPs as one */
+	for (int i = 0; i < L64X0_CMD_MAX_BYTES - 1 && ret == 0; i++) {
+		ret = send_command_locked(dev, CMD_NOP, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+	}
+
+	if (ret == 0) {
+		ret = send_command_locked(dev, CMD_GET_STATUS, 0, TX_BYTES_NONE,
+					  RX_BYTES_GET_STATUS);
+	}
+
+	if (ret >= 0) {
+		alarms = l64x0_alarm_decode(dev, ret);
+		if (alarms & BIT(L64X0_ALARM_CMD_ERROR)) {
+			data->errors.cmd++;
+		}
+
+		/* GET_STATUS cleared them, the FLAG work item still reports them */
+		alarms &= ~BIT(L64X0_ALARM_CMD_ERROR);
+		if (alarms != 0 && ((const struct l64x0_config *)dev->config)->flag.port != NULL) {
+			atomic_or(&data->alarm_pending, alarms);
+			k_work_submit(&data->alarm_work);
+		}
+
+		ret = l64x0_restore_locked(dev, ret);
+	}
+
+	data->recovering = false;
+
+	if (ret < 0) {
+		data->errors.unrecovered++;
+		LOG_ERR("%s: recovery failed (%d)", dev->name, ret);
+	} else {
+		data->errors.recovered++;
+		LOG_WRN("%s: recovered from a transfer error", dev->name);
+	}
+
+	return ret;
+}
+
+int l64x0_setparam(const struct device *const dev, uint8_t param, uint32_t val)
+{
+	uint32_t status = L64X0_STATUS_UNREAD;
+	int ret;
+
+	if (!is_valid(dev, param)) {
+		LOG_ERR("param = %x", param);
+		return -EINVAL;
+	}
+
+	l64x0_lock(dev);
+	ret = l64x0_setparam_locked(dev, param, val, &status);
+	l64x0_unlock(dev);
+
+	return ret;
+}
+
+int l64x0_getparam(const struct device *const dev, uint8_t param, uint32_t *val)
+{
+	int ret;
+
+	if (!is_valid(dev, param)) {
+		LOG_ERR("param = %x", param);
+		return -EINVAL;
+	}
+
+	l64x0_lock(dev);
+	ret = l64x0_getparam_locked(dev, param, val);
+	l64x0_unlock(dev);
+
+	return ret;
+}
+
+void l64x0_error_counters_get(const struct device *const dev,
+			      struct l64x0_error_counters *counters)
+{
+	struct l64x0_data *data = dev->data;
+
+	l64x0_lock(dev);
+	*counters = data->errors;
+	l64x0_unlock(dev);
+}
+
+#ifdef CONFIG_L64X0_STATS
+int l64x0_stats_get(const struct device *const dev, enum l64x0_op op,
+		    struct l64x0_op_stats *stats)
+{
+	struct l64x0_data *data = dev->data;
+
+	if (op >= L64X0_OP_COUNT) {
+		return -EINVAL;
+	}
+
+	l64x0_lock(dev);
+	*stats = data->stats[op];
+	l64x0_unlock(dev);
+
+	return 0;
+}
+
+void l64x0_stats_reset(const struct device *const dev)
+{
+	struct l64x0_data *data = dev->data;
+
+	l64x0_lock(dev);
+	memset(data->stats, 0, sizeof(data->stats));
+	l64x0_unlock(dev);
+}
+#endif /* CONFIG_L64X0_STATS */
+
+int l64x0_profile_apply(const struct device *const dev, const struct l64x0_profile *profile)
+{
+	uint32_t status = L64X0_STATUS_UNREAD;
+	int ret = 0;
+
+	if (profile->mask & (VOLATILE_REGS | BIT(0) | ~GENMASK(L64x0_ADDR_LAST - 1, 0))) {
+		LOG_ERR("profile mask = %x", profile->mask);
+		return -EINVAL;
+	}
+
+	l64x0_lock(dev);
+
+	for (uint8_t param = 1; param < L64x0_ADDR_LAST && ret == 0; param++) {
+		if ((profile->mask & BIT(param)) && is_valid(dev, param)) {
+			ret = l64x0_setparam_locked(dev, param, profile->regs[param], &status);
+		}
+	}
+
+	l64x0_unlock(dev);
+
+	return ret;
+}
+
+int l64x0_profile_get(const struct device *const dev, struct l64x0_profile *profile)
+{
+	uint32_t val;
+	int ret = 0;
+
+	profile->mask = 0;
+
+	l64x0_lock(dev);
+
+	for (uint8_t param = 1; param < L64x0_ADDR_LAST; param++) {
+		if (!is_cached(param) || !is_valid(dev, param)) {
+			continue;
+		}
+
+		ret = l64x0_getparam_locked(dev, param, &val);
+		if (ret < 0) {
+			break;
+		}
+
+		l64x0_profile_set(profile, param, val);
+	}
+
+	l64x0_unlock(dev);
+
+	return ret;
+}
+
+int l64x0_snapshot(const struct device *const dev, uint32_t mask,
+		   struct l64x0_snapshot *snapshot)
+{
+	int ret = 0;
+
+	for (uint8_t param = 0; param < 32; param++) {
+		if ((mask & BIT(param)) && !is_valid(dev, param)) {
+			return -EINVAL;
+		}
+	}
+
+	snapshot->mask = mask;
+
+	l64x0_lock(dev);
+
+	/* Stamped once the bus is ours, right before the first read */
+	snapshot->uptime_ticks = k_uptime_ticks();
+
+	for (uint8_t param = 1; param < L64x0_ADDR_LAST; param++) {
+		if (!(mask & BIT(param))) {
+			continue;
+		}
+
+		ret = l64x0_getparam_locked(dev, param, &snapshot->regs[param]);
+		if (ret < 0) {
+			break;
+		}
+	}
+
+	l64x0_unlock(dev);
+
+	return ret;
+}
+
+int l64x0_run(const struct device *const dev, int speed)
+{
+        bool dir = speed >= 0;
+
+	return send_command(dev, CMD_RUN | dir, abs(speed), TX_BYTES_RUN, RX_BYTES_NONE);
+}
+
+int l64x0_move(const struct device *const dev, int n_step)
+{
+        bool dir = n_step >= 0;
+
+	return send_command(dev, CMD_MOVE | dir, abs(n_step), TX_BYTES_MOVE, RX_BYTES_NONE);
+}
+
+int l64x0_goto(const struct device *const dev, int32_t abs_pos)
+{
+	return send_command(dev, CMD_GOTO, abs_pos & GENMASK(21, 0), TX_BYTES_GOTO,
+			    RX_BYTES_NONE);
+}
+
+int l64x0_goto_dir(const struct device *const dev, int32_t abs_pos, bool forward)
+{
+	return send_command(dev, CMD_GOTO_DIR | forward, abs_pos & GENMASK(21, 0),
+			    TX_BYTES_GOTO, RX_BYTES_NONE);
+}
+
+int l64x0_go_until(const struct device *const dev, enum l64x0_sw_action act, int speed)
+{
+	bool dir = speed >= 0;
+
+	return send_command(dev, CMD_GO_UNTIL | (act ? CMD_SW_ACT : 0) | dir, abs(speed),
+			    TX_BYTES_GO_UNTIL, RX_BYTES_NONE);
+}
+
+int l64x0_release_sw(const struct device *const dev, enum l64x0_sw_action act, bool forward)
+{
+	return send_command_simple(dev, CMD_RELEASE_SW | (act ? CMD_SW_ACT : 0) | forward);
+}
+
+int l64x0_go_home(const struct device *const dev)
+{
+	return send_command_simple(dev, CMD_GO_HOME);
+}
+
+int l64x0_go_mark(const struct device *const dev)
+{
+	return send_command_simple(dev, CMD_GO_MARK);
+}
+
+int l64x0_reset_pos(const struct device *const dev)
+{
+	return send_command_simple(dev, CMD_RESET_POS);
+}
+
+int l64x0_home(const struct device *const dev, int speed, enum l64x0_sw_action act,
+	       k_timeout_t timeout)
+{
+	k_timepoint_t end = sys_timepoint_calc(timeout);
+	uint32_t status;
+	int ret;
+
+	/* Fast approach, the chip soft stops on the switch edge */
+	ret = l64x0_go_until(dev, act, speed);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = l64x0_wait_idle(dev, sys_timepoint_timeout(end));
+	if (ret < 0) {
+		l64x0_hard_stop(dev);
+		return ret;
+	}
+
+	/*
+	 * Stopped by something else than the switch, e.g. a fault. The switch
+	 * may have bounced open during deceleration, so check the latched
+	 * event; GET_PARAM leaves it to the FLAG handler.
+	 */
+	ret = l64x0_getparam(dev, L64x0_ADDR_STATUS, &status);
+	if (ret < 0) {
+		return ret;
+	}
+	if (!(status & L64X0_STATUS_SW_EVN)) {
+		return -EIO;
+	}
+
+	/* Back off slowly, the position is taken where the switch opens */
+	ret = l64x0_release_sw(dev, act, speed < 0);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = l64x0_wait_idle(dev, sys_timepoint_timeout(end));
+	if (ret < 0) {
+		l64x0_hard_stop(dev);
+	}
+
+	return ret;
+}
+
+int l64x0_step_clock(const struct device *const dev, bool forward)
+{
+	return send_command_simple(dev, CMD_STEP_CLOCK | forward);
+}
+
+int l64x0_reset_device(const struct device *const dev)
+{
+	struct l64x0_data *data = dev->data;
+	int ret;
+
+	/* Every register goes back to its reset value, held against writes */
+	l64x0_lock(dev);
+	atomic_set(&data->dirty, (atomic_val_t)GENMASK(L64x0_ADDR_LAST - 1, 0));
+	data->known = 0;
+	ret = send_command_locked(dev, CMD_RESET_DEVICE, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+	l64x0_unlock(dev);
+
+	return ret;
+}
+
+int l64x0_soft_stop(const struct device *const dev)
+{
+        return send_command_simple(dev, CMD_SOFT_STOP);
+}
+
+int l64x0_hard_stop(const struct device *const dev)
+{
+        return send_command_simple(dev, CMD_HARD_STOP);
+}
+
+int l64x0_soft_hiz(const struct device *const dev)
+{
+        return send_command_simple(dev, CMD_SOFT_HIZ);
+}
+
+int l64x0_hard_hiz(const struct device *const dev)
+{
+        return send_command_simple(dev, CMD_HARD_HIZ);
+}
+
+int l64x0_get_status(const struct device *const dev, uint16_t *status)
+{
+	int ret;
+
+	ret = send_command(dev, CMD_GET_STATUS, 0, TX_BYTES_NONE, RX_BYTES_GET_STATUS);
+	if (ret < 0) {
+		return ret;
+	}
+
+	*status = ret;
+
+	return 0;
+}
+
+void l64x0_cmd_nop(struct l64x0_cmd *cmd, const struct device *const dev)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_NOP, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+int l64x0_cmd_setparam(struct l64x0_cmd *cmd, const struct device *const dev,
+		       uint8_t param, uint32_t val)
+{
+	const struct l64x0_config *config = dev->config;
+	const struct l64x0_variant *variant = config->variant;
+
+	if (!is_valid(dev, param)) {
+		LOG_ERR("param = %x", param);
+		return -EINVAL;
+	}
+
+	l64x0_cmd_prepare(cmd, dev, CMD_SET_PARAM | variant->addr[param], val,
+			  BITS_TO_BYTES(variant->bit_len[param]), RX_BYTES_NONE);
+
+	/* Sent behind the shadow's back, read the chip next time */
+	atomic_set_bit(&((struct l64x0_data *)dev->data)->dirty, param);
+
+	return 0;
+}
+
+int l64x0_cmd_getparam(struct l64x0_cmd *cmd, const struct device *const dev, uint8_t param)
+{
+	const struct l64x0_config *config = dev->config;
+	const struct l64x0_variant *variant = config->variant;
+
+	if (!is_valid(dev, param)) {
+		LOG_ERR("param = %x", param);
+		return -EINVAL;
+	}
+
+	l64x0_cmd_prepare(cmd, dev, CMD_GET_PARAM | variant->addr[param], 0,
+			  TX_BYTES_NONE, BITS_TO_BYTES(variant->bit_len[param]));
+
+	return 0;
+}
+
+void l64x0_cmd_run(struct l64x0_cmd *cmd, const struct device *const dev, int speed)
+{
+	bool dir = speed >= 0;
+
+	l64x0_cmd_prepare(cmd, dev, CMD_RUN | dir, abs(speed), TX_BYTES_RUN, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_move(struct l64x0_cmd *cmd, const struct device *const dev, int n_step)
+{
+	bool dir = n_step >= 0;
+
+	l64x0_cmd_prepare(cmd, dev, CMD_MOVE | dir, abs(n_step), TX_BYTES_MOVE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_goto(struct l64x0_cmd *cmd, const struct device *const dev, int32_t abs_pos)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_GOTO, abs_pos & GENMASK(21, 0), TX_BYTES_GOTO,
+			  RX_BYTES_NONE);
+}
+
+void l64x0_cmd_goto_dir(struct l64x0_cmd *cmd, const struct device *const dev, int32_t abs_pos,
+			bool forward)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_GOTO_DIR | forward, abs_pos & GENMASK(21, 0),
+			  TX_BYTES_GOTO, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_go_until(struct l64x0_cmd *cmd, const struct device *const dev,
+			enum l64x0_sw_action act, int speed)
+{
+	bool dir = speed >= 0;
+
+	l64x0_cmd_prepare(cmd, dev, CMD_GO_UNTIL | (act ? CMD_SW_ACT : 0) | dir, abs(speed),
+			  TX_BYTES_GO_UNTIL, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_release_sw(struct l64x0_cmd *cmd, const struct device *const dev,
+			  enum l64x0_sw_action act, bool forward)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_RELEASE_SW | (act ? CMD_SW_ACT : 0) | forward, 0,
+			  TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_go_home(struct l64x0_cmd *cmd, const struct device *const dev)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_GO_HOME, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_go_mark(struct l64x0_cmd *cmd, const struct device *const dev)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_GO_MARK, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_reset_pos(struct l64x0_cmd *cmd, const struct device *const dev)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_RESET_POS, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_step_clock(struct l64x0_cmd *cmd, const struct device *const dev, bool forward)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_STEP_CLOCK | forward, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_soft_stop(struct l64x0_cmd *cmd, const struct device *const dev)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_SOFT_STOP, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_hard_stop(struct l64x0_cmd *cmd, const struct device *const dev)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_HARD_STOP, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_soft_hiz(struct l64x0_cmd *cmd, const struct device *const dev)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_SOFT_HIZ, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_hard_hiz(struct l64x0_cmd *cmd, const struct device *const dev)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_HARD_HIZ, 0, TX_BYTES_NONE, RX_BYTES_NONE);
+}
+
+void l64x0_cmd_get_status(struct l64x0_cmd *cmd, const struct device *const dev)
+{
+	l64x0_cmd_prepare(cmd, dev, CMD_GET_STATUS, 0, TX_BYTES_NONE, RX_BYTES_GET_STATUS);
+}
+
+enum l64x0_variant_id l64x0_variant(const struct device *const dev)
+{
+	const struct l64x0_config *config = dev->config;
+
+	return config->variant->id;
+}
+
+static void l64x0_busy_isr(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+	struct l64x0_data *data = CONTAINER_OF(cb, struct l64x0_data, busy_cb);
+
+	k_poll_signal_raise(&data->idle, 0);
+#ifdef CONFIG_L64X0_MOTION_QUEUE
+	k_work_reschedule(&data->motion_work, K_NO_WAIT);
+#endif
+}
+
+static int l64x0_busy_init(const struct device *dev)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+	int ret;
+
+	if (!gpio_is_ready_dt(&config->busy)) {
+		LOG_ERR("BUSY GPIO %s not ready", config->busy.port->name);
+		return -ENODEV;
+	}
+
+	k_poll_signal_init(&data->idle);
+
+	ret = gpio_pin_configure_dt(&config->busy, GPIO_INPUT);
+	if (ret < 0) {
+		return ret;
+	}
+
+	gpio_init_callback(&data->busy_cb, l64x0_busy_isr, BIT(config->busy.pin));
+	ret = gpio_add_callback_dt(&config->busy, &data->busy_cb);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return gpio_pin_interrupt_configure_dt(&config->busy, GPIO_INT_EDGE_TO_INACTIVE);
+}
+
+struct k_poll_signal *l64x0_idle_signal(const struct device *const dev)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+
+	return config->busy.port != NULL ? &data->idle : NULL;
+}
+
+#define L64X0_READY_POLL_US	50
+#define L64X0_READY_POLL_MAX_US	1000
+#define L64X0_READY_TIMEOUT	K_MSEC(10)
+
+/*
+ * Poll STATUS until all bits of mask are set, backing off from a few
+ * tens of microseconds. Reading STATUS clears the UVLO latched by a
+ * reset, so waiting for it takes a second read on a healthy supply.
+ * The alarms cleared on the way are added to alarms unless it is NULL.
+ */
+static int l64x0_wait_status(const struct device *dev, uint16_t mask, k_timeout_t timeout,
+			     uint32_t *alarms)
+{
+	k_timepoint_t end = sys_timepoint_calc(timeout);
+	uint32_t delay_us = L64X0_READY_POLL_US;
+	uint16_t status;
+	int ret;
+
+	for (;;) {
+		ret = l64x0_get_status(dev, &status);
+		if (ret < 0) {
+			return ret;
+		}
+		/* MISO reads all zeros or all ones while the logic is still off */
+		if (status != 0 && status != UINT16_MAX) {
+			if (alarms != NULL) {
+				*alarms |= l64x0_alarm_decode(dev, status);
+			}
+			if ((status & mask) == mask) {
+				return 0;
+			}
+		}
+		if (sys_timepoint_expired(end)) {
+			return -ETIMEDOUT;
+		}
+		k_usleep(delay_us);
+		delay_us = MIN(delay_us * 2, L64X0_READY_POLL_MAX_US);
+	}
+}
+
+int l64x0_wait_ready(const struct device *const dev, k_timeout_t timeout)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+	uint32_t alarms = 0;
+	int ret;
+
+	ret = l64x0_wait_status(dev, L64X0_STATUS_UVLO, timeout, &alarms);
+
+	/* GET_STATUS cleared them, the FLAG work item still reports them */
+	if (alarms != 0 && config->flag.port != NULL) {
+		atomic_or(&data->alarm_pending, alarms);
+		k_work_submit(&data->alarm_work);
+	}
+
+	return ret;
+}
+
+/* Without the pin; GET_PARAM leaves the latched alarms to the FLAG handler */
+static int l64x0_wait_idle_poll(const struct device *const dev, k_timeout_t timeout)
+{
+	k_timepoint_t end = sys_timepoint_calc(timeout);
+	uint32_t status;
+	int ret;
+
+	for (;;) {
+		ret = l64x0_getparam(dev, L64x0_ADDR_STATUS, &status);
+		if (ret < 0) {
+			return ret;
+		}
+		if (status & L64X0_STATUS_BUSY) {
+			return 0;
+		}
+		if (sys_timepoint_expired(end)) {
+			return -EAGAIN;
+		}
+		k_sleep(K_MSEC(CONFIG_L64X0_BUSY_POLL_MS));
+	}
+}
+
+int l64x0_wait_idle(const struct device *const dev, k_timeout_t timeout)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+	struct k_poll_event event = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL,
+							     K_POLL_MODE_NOTIFY_ONLY,
+							     &data->idle);
+	int ret;
+
+	if (config->busy.port == NULL) {
+		return l64x0_wait_idle_poll(dev, timeout);
+	}
+
+	/* Reset first, so an edge right after the pin check is not lost */
+	k_poll_signal_reset(&data->idle);
+
+	ret = gpio_pin_get_dt(&config->busy);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	return k_poll(&event, 1, timeout);
+}
+
+#ifdef CONFIG_L64X0_MOTION_QUEUE
+/* 1 while a motion runs, from the pin or else STATUS */
+static int l64x0_busy(const struct device *const dev)
+{
+	const struct l64x0_config *config = dev->config;
+	uint32_t status;
+	int ret;
+
+	if (config->busy.port != NULL) {
+		return gpio_pin_get_dt(&config->busy);
+	}
+
+	ret = l64x0_getparam(dev, L64x0_ADDR_STATUS, &status);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return !(status & L64X0_STATUS_BUSY);
+}
+
+static int l64x0_motion_dispatch(const struct device *const dev,
+				 const struct l64x0_motion *motion)
+{
+	int ret;
+
+	if (motion->profile != NULL) {
+		ret = l64x0_profile_apply(dev, motion->profile);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	switch (motion->op) {
+	case L64X0_MOTION_MOVE:
+		return l64x0_move(dev, motion->arg);
+	case L64X0_MOTION_GOTO:
+		return l64x0_goto(dev, motion->arg);
+	case L64X0_MOTION_RUN:
+		return l64x0_run(dev, motion->arg);
+	case L64X0_MOTION_SOFT_STOP:
+		return l64x0_soft_stop(dev);
+	case L64X0_MOTION_HARD_STOP:
+		return l64x0_hard_stop(dev);
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Send entries for as long as the chip is idle, then wait for BUSY again */
+static void l64x0_motion_work(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct l64x0_data *data = CONTAINER_OF(dwork, struct l64x0_data, motion_work);
+	const struct device *dev = data->dev;
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_motion motion;
+	int ret;
+
+	for (;;) {
+		ret = l64x0_busy(dev);
+		if (ret < 0) {
+			break;
+		}
+		if (ret > 0) {
+			/* Without the pin nothing calls us back */
+			if (config->busy.port == NULL) {
+				k_work_schedule(dwork, K_MSEC(CONFIG_L64X0_BUSY_POLL_MS));
+			}
+			return;
+		}
+
+		if (k_msgq_get(&data->motion_q, &motion, K_NO_WAIT) < 0) {
+			if (atomic_cas(&data->motion_active, true, false)) {
+				k_poll_signal_raise(&data->motion_done, 0);
+			}
+			return;
+		}
+
+		atomic_set(&data->motion_active, true);
+		ret = l64x0_motion_dispatch(dev, &motion);
+		if (ret < 0) {
+			break;
+		}
+	}
+
+	LOG_ERR("%s: motion queue flushed (%d)", dev->name, ret);
+	k_msgq_purge(&data->motion_q);
+	atomic_clear(&data->motion_active);
+	k_poll_signal_raise(&data->motion_done, ret);
+}
+
+int l64x0_motion_enqueue(const struct device *const dev, const struct l64x0_motion *motion,
+			 k_timeout_t timeout)
+{
+	struct l64x0_data *data = dev->data;
+	int ret;
+
+	if (motion->op > L64X0_MOTION_HARD_STOP) {
+		return -EINVAL;
+	}
+
+	/* Reset first, once queued the entry may end before we run again */
+	k_poll_signal_reset(&data->motion_done);
+	ret = k_msgq_put(&data->motion_q, motion, timeout);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_work_reschedule(&data->motion_work, K_NO_WAIT);
+
+	return 0;
+}
+
+int l64x0_motion_flush(const struct device *const dev)
+{
+	struct l64x0_data *data = dev->data;
+	unsigned int signaled;
+	int result;
+
+	k_msgq_purge(&data->motion_q);
+
+	/* The entries waited for are gone, do not leave waiters hanging */
+	atomic_clear(&data->motion_active);
+	k_poll_signal_check(&data->motion_done, &signaled, &result);
+	if (!signaled) {
+		k_poll_signal_raise(&data->motion_done, -ECANCELED);
+	}
+
+	return 0;
+}
+
+struct k_poll_signal *l64x0_motion_signal(const struct device *const dev)
+{
+	struct l64x0_data *data = dev->data;
+
+	return &data->motion_done;
+}
+#endif /* CONFIG_L64X0_MOTION_QUEUE */
+
+#ifdef CONFIG_L64X0_STEP_CLOCK
+size_t l64x0_stck_table(const uint32_t *sps, size_t n, uint32_t dt_us,
+			struct l64x0_stck_segment *table)
+{
+	/* Steps not yet issued, in millionths */
+	uint64_t frac = 0;
+	size_t len = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		uint32_t period_ns;
+		uint32_t steps;
+
+		if (sps[i] == 0) {
+			continue;
+		}
+
+		frac += (uint64_t)sps[i] * dt_us;
+		steps = frac / USEC_PER_SEC;
+		frac %= USEC_PER_SEC;
+		if (steps == 0) {
+			continue;
+		}
+
+		period_ns = NSEC_PER_SEC / sps[i];
+		if (len > 0 && table[len - 1].period_ns == period_ns) {
+			table[len - 1].steps += steps;
+		} else {
+			table[len].period_ns = period_ns;
+			table[len].steps = steps;
+			len++;
+		}
+	}
+
+	return len;
+}
+
+/* Rising edges period_ns apart, or STCK held low */
+static int l64x0_stck_output(const struct l64x0_config *config, uint32_t period_ns)
+{
+	if (period_ns == 0) {
+		return pwm_set_dt(&config->stck, config->stck.period, 0);
+	}
+
+	return pwm_set_dt(&config->stck, period_ns, period_ns / 2);
+}
+
+/* Start the next segment, or end the table; also runs from the timer ISR */
+static void l64x0_stck_advance(const struct device *dev)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+	const struct l64x0_stck_segment *seg;
+	int ret;
+
+	if (data->stck_next == data->stck_len) {
+		data->stck_table = NULL;
+		l64x0_stck_output(config, 0);
+		k_poll_signal_raise(&data->stck_done, 0);
+		return;
+	}
+
+	seg = &data->stck_table[data->stck_next++];
+	ret = l64x0_stck_output(config, seg->period_ns);
+	if (ret < 0) {
+		data->stck_table = NULL;
+		l64x0_stck_output(config, 0);
+		k_poll_signal_raise(&data->stck_done, ret);
+		return;
+	}
+
+	k_timer_start(&data->stck_timer, K_NSEC((uint64_t)seg->period_ns * seg->steps),
+		      K_NO_WAIT);
+}
+
+static void l64x0_stck_expiry(struct k_timer *timer)
+{
+	struct l64x0_data *data = CONTAINER_OF(timer, struct l64x0_data, stck_timer);
+
+	l64x0_stck_advance(data->dev);
+}
+
+/* Abandon a table being played, leaving STCK as it is */
+static void l64x0_stck_cancel(const struct device *const dev)
+{
+	struct l64x0_data *data = dev->data;
+
+	k_timer_stop(&data->stck_timer);
+	if (data->stck_table != NULL) {
+		data->stck_table = NULL;
+		k_poll_signal_raise(&data->stck_done, -ECANCELED);
+	}
+}
+
+int l64x0_stck_start(const struct device *const dev, bool forward,
+		     const struct l64x0_stck_segment *table, size_t n)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+	int ret;
+
+	if (config->stck.dev == NULL) {
+		return -ENOTSUP;
+	}
+
+	if (n == 0) {
+		return -EINVAL;
+	}
+
+	l64x0_stck_cancel(dev);
+	l64x0_stck_output(config, 0);
+
+	ret = l64x0_step_clock(dev, forward);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_poll_signal_reset(&data->stck_done);
+	data->stck_table = table;
+	data->stck_len = n;
+	data->stck_next = 0;
+	l64x0_stck_advance(dev);
+
+	return 0;
+}
+
+int l64x0_stck_set_period(const struct device *const dev, uint32_t period_ns)
+{
+	const struct l64x0_config *config = dev->config;
+
+	if (config->stck.dev == NULL) {
+		return -ENOTSUP;
+	}
+
+	l64x0_stck_cancel(dev);
+
+	return l64x0_stck_output(config, period_ns);
+}
+
+int l64x0_stck_stop(const struct device *const dev)
+{
+	return l64x0_stck_set_period(dev, 0);
+}
+
+struct k_poll_signal *l64x0_stck_signal(const struct device *const dev)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+
+	return config->stck.dev != NULL ? &data->stck_done : NULL;
+}
+
+static int l64x0_stck_init(const struct device *dev)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+
+	if (!pwm_is_ready_dt(&config->stck)) {
+		LOG_ERR("STCK PWM %s not ready", config->stck.dev->name);
+		return -ENODEV;
+	}
+
+	k_timer_init(&data->stck_timer, l64x0_stck_expiry, NULL);
+	k_poll_signal_init(&data->stck_done);
+
+	return l64x0_stck_output(config, 0);
+}
+#endif /* CONFIG_L64X0_STEP_CLOCK */
+
+#ifdef CONFIG_L64X0_TELEMETRY
+static void l64x0_telemetry_work(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct l64x0_data *data = CONTAINER_OF(dwork, struct l64x0_data, telemetry_work);
+	const struct device *dev = data->dev;
+	uint32_t head = (uint32_t)atomic_get(&data->ring_head);
+	struct l64x0_telemetry_slot *slot =
+		&data->ring[head & (CONFIG_L64X0_TELEMETRY_DEPTH - 1)];
+	struct l64x0_snapshot snapshot;
+	struct l64x0_sample sample;
+	int i = 0;
+	int ret;
+
+	ret = l64x0_snapshot(dev, data->telemetry_mask, &snapshot);
+	if (ret == 0) {
+		sample.uptime_ticks = snapshot.uptime_ticks;
+		sample.mask = snapshot.mask;
+		for (uint8_t param = 1; param < L64x0_ADDR_LAST; param++) {
+			if (snapshot.mask & BIT(param)) {
+				sample.val[i++] = snapshot.regs[param];
+			}
+		}
+	}
+
+	if (ret < 0) {
+		LOG_ERR("%s: telemetry read failed (%d)", dev->name, ret);
+	} else {
+		atomic_inc(&slot->seq);
+		slot->idx = head;
+		slot->sample = sample;
+		atomic_inc(&slot->seq);
+		atomic_set(&data->ring_head, (atomic_val_t)(head + 1));
+	}
+
+	k_work_schedule(dwork, data->telemetry_period);
+}
+
+int l64x0_telemetry_start(const struct device *const dev, uint32_t mask, k_timeout_t period)
+{
+	struct l64x0_data *data = dev->data;
+	struct k_work_sync sync;
+
+	if (POPCOUNT(mask) > CONFIG_L64X0_TELEMETRY_MAX_REGS) {
+		return -EINVAL;
+	}
+
+	for (uint8_t param = 0; param < 32; param++) {
+		if ((mask & BIT(param)) && !is_valid(dev, param)) {
+			return -EINVAL;
+		}
+	}
+
+	k_work_cancel_delayable_sync(&data->telemetry_work, &sync);
+	data->telemetry_mask = mask;
+	data->telemetry_period = period;
+	k_work_schedule(&data->telemetry_work, K_NO_WAIT);
+
+	return 0;
+}
+
+int l64x0_telemetry_stop(const struct device *const dev)
+{
+	struct l64x0_data *data = dev->data;
+	struct k_work_sync sync;
+
+	k_work_cancel_delayable_sync(&data->telemetry_work, &sync);
+
+	return 0;
+}
+
+int l64x0_telemetry_read(const struct device *const dev, uint32_t age,
+			 struct l64x0_sample *sample)
+{
+	struct l64x0_data *data = dev->data;
+	struct l64x0_telemetry_slot *slot;
+	uint32_t idx, slot_idx;
+	atomic_val_t seq;
+
+	if (age >= CONFIG_L64X0_TELEMETRY_DEPTH) {
+		return -ENODATA;
+	}
+
+	/* Retry while the sampler overwrites the slot under us */
+	do {
+		idx = (uint32_t)atomic_get(&data->ring_head) - 1 - age;
+		slot = &data->ring[idx & (CONFIG_L64X0_TELEMETRY_DEPTH - 1)];
+		seq = atomic_get(&slot->seq);
+		barrier_dmem_fence_full();
+		slot_idx = slot->idx;
+		*sample = slot->sample;
+		barrier_dmem_fence_full();
+	} while ((seq & 1) || seq != atomic_get(&slot->seq));
+
+	/* Not taken yet, or already replaced by a newer sample */
+	return (slot_idx == idx) ? 0 : -ENODATA;
+}
+#endif /* CONFIG_L64X0_TELEMETRY */
+
+#ifdef CONFIG_L64X0_SENSOR
+#define L64X0_SENSOR_REGS						\
+	(BIT(L64x0_ADDR_ABS_POS) | BIT(L64x0_ADDR_SPEED) |		\
+	 BIT(L64x0_ADDR_ADC_OUT) | BIT(L64x0_ADDR_STATUS))
+
+BUILD_ASSERT(L64X0_ALARM_COUNT <= 16, "faults must fit their q31 shift");
+
+/* Integer bits of each channel in q31 */
+static const int8_t l64x0_sensor_shift[] = {
+	[L64X0_CHAN_SPEED - SENSOR_CHAN_PRIV_START] = 14,
+	[L64X0_CHAN_POSITION - SENSOR_CHAN_PRIV_START] = 22,
+	[L64X0_CHAN_ADC_OUT - SENSOR_CHAN_PRIV_START] = 5,
+	[L64X0_CHAN_THERMAL - SENSOR_CHAN_PRIV_START] = 2,
+	[L64X0_CHAN_FAULTS - SENSOR_CHAN_PRIV_START] = 16,
+};
+
+static int l64x0_sensor_encode(const struct device *dev, struct l64x0_sensor_frame *frame)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_snapshot snapshot;
+	int ret;
+
+	ret = l64x0_snapshot(dev, L64X0_SENSOR_REGS, &snapshot);
+	if (ret < 0) {
+		return ret;
+	}
+
+	frame->timestamp_ns = k_ticks_to_ns_floor64(snapshot.uptime_ticks);
+	frame->abs_pos = snapshot.regs[L64x0_ADDR_ABS_POS];
+	frame->speed = snapshot.regs[L64x0_ADDR_SPEED];
+	frame->status = snapshot.regs[L64x0_ADDR_STATUS];
+	frame->adc_out = snapshot.regs[L64x0_ADDR_ADC_OUT];
+	frame->variant = config->variant->id;
+
+	return 0;
+}
+
+/* A channel of a frame in millionths of its unit */
+static int l64x0_sensor_micro(const struct l64x0_sensor_frame *frame, uint16_t chan,
+			      int64_t *micro)
+{
+	const struct l64x0_variant *variant =
+		(frame->variant == L64X0_VARIANT_L6480) ? &l6480_variant : &l6470_variant;
+	uint32_t alarms = variant->alarms(frame->status);
+
+	switch (chan) {
+	case L64X0_CHAN_SPEED:
+		/* Steps per second, negative in reverse */
+		*micro = ((uint64_t)frame->speed * 15625U * 1000000U) >> 20;
+		if (!(frame->status & L64X0_STATUS_DIR)) {
+			*micro = -*micro;
+		}
+		return 0;
+	case L64X0_CHAN_POSITION:
+		*micro = (int64_t)sign_extend(frame->abs_pos, 21) * 1000000;
+		return 0;
+	case L64X0_CHAN_ADC_OUT:
+		*micro = (int64_t)frame->adc_out * 1000000;
+		return 0;
+	case L64X0_CHAN_THERMAL:
+		*micro = (alarms & BIT(L64X0_ALARM_TH_SD)) ? 2 :
+			 (alarms & BIT(L64X0_ALARM_TH_WRN)) ? 1 : 0;
+		*micro *= 1000000;
+		return 0;
+	case L64X0_CHAN_FAULTS:
+		*micro = (int64_t)alarms * 1000000;
+		return 0;
+	default:
+		return -ENOTSUP;
+	}
+}
+
+static int l64x0_sensor_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+	struct l64x0_data *data = dev->data;
+
+	if (chan != SENSOR_CHAN_ALL &&
+	    ((int)chan < L64X0_CHAN_SPEED || (int)chan > L64X0_CHAN_FAULTS)) {
+		return -ENOTSUP;
+	}
+
+	return l64x0_sensor_encode(dev, &data->sensor);
+}
+
+static int l64x0_sensor_channel_get(const struct device *dev, enum sensor_channel chan,
+				    struct sensor_value *val)
+{
+	struct l64x0_data *data = dev->data;
+	int64_t micro;
+	int ret;
+
+	ret = l64x0_sensor_micro(&data->sensor, chan, &micro);
+	if (ret < 0) {
+		return ret;
+	}
+
+	val->val1 = micro / 1000000;
+	val->val2 = micro % 1000000;
+
+	return 0;
+}
+
+static bool l64x0_sensor_chan_valid(struct sensor_chan_spec chan)
+{
+	return chan.chan_type >= L64X0_CHAN_SPEED && chan.chan_type <= L64X0_CHAN_FAULTS &&
+	       chan.chan_idx == 0;
+}
+
+static int l64x0_decoder_get_frame_count(const uint8_t *buffer, struct sensor_chan_spec chan,
+					 uint16_t *frame_count)
+{
+	if (!l64x0_sensor_chan_valid(chan)) {
+		return -ENOTSUP;
+	}
+
+	*frame_count = 1;
+
+	return 0;
+}
+
+static int l64x0_decoder_get_size_info(struct sensor_chan_spec chan, size_t *base_size,
+				       size_t *frame_size)
+{
+	if (!l64x0_sensor_chan_valid(chan)) {
+		return -ENOTSUP;
+	}
+
+	*base_size = sizeof(struct sensor_q31_data);
+	*frame_size = sizeof(struct sensor_q31_sample_data);
+
+	return 0;
+}
+
+static int l64x0_decoder_decode(const uint8_t *buffer, struct sensor_chan_spec chan,
+				uint32_t *fit, uint16_t max_count, void *data_out)
+{
+	const struct l64x0_sensor_frame *frame = (const struct l64x0_sensor_frame *)buffer;
+	struct sensor_q31_data *out = data_out;
+	int8_t shift;
+	int64_t micro;
+	int ret;
+
+	if (*fit != 0 || max_count == 0) {
+		return 0;
+	}
+
+	if (!l64x0_sensor_chan_valid(chan)) {
+		return -ENOTSUP;
+	}
+
+	ret = l64x0_sensor_micro(frame, chan.chan_type, &micro);
+	if (ret < 0) {
+		return ret;
+	}
+
+	shift = l64x0_sensor_shift[chan.chan_type - SENSOR_CHAN_PRIV_START];
+	out->header.base_timestamp_ns = frame->timestamp_ns;
+	out->header.reading_count = 1;
+	out->shift = shift;
+	out->readings[0].timestamp_delta = 0;
+	out->readings[0].value = (micro * ((int64_t)1 << (31 - shift))) / 1000000;
+	*fit = 1;
+
+	return 1;
+}
+
+static bool l64x0_decoder_has_trigger(const uint8_t *buffer, enum sensor_trigger_type trigger)
+{
+	return false;
+}
+
+static const struct sensor_decoder_api l64x0_decoder_api = {
+	.get_frame_count = l64x0_decoder_get_frame_count,
+	.get_size_info = l64x0_decoder_get_size_info,
+	.decode = l64x0_decoder_decode,
+	.has_trigger = l64x0_decoder_has_trigger,
+};
+
+static int l64x0_sensor_get_decoder(const struct device *dev,
+				    const struct sensor_decoder_api **api)
+{
+	*api = &l64x0_decoder_api;
+
+	return 0;
+}
+
+#ifdef CONFIG_SENSOR_ASYNC_API
+/*
+ * Every channel comes from one snapshot, written raw into the caller's
+ * buffer and only converted when decoded.
+ */
+static void l64x0_sensor_submit(const struct device *dev, struct rtio_iodev_sqe *iodev_sqe)
+{
+	uint32_t buf_len;
+	uint8_t *buf;
+	int ret;
+
+	ret = rtio_sqe_rx_buf(iodev_sqe, sizeof(struct l64x0_sensor_frame),
+			      sizeof(struct l64x0_sensor_frame), &buf, &buf_len);
+	if (ret == 0) {
+		ret = l64x0_sensor_encode(dev, (struct l64x0_sensor_frame *)buf);
+	}
+
+	if (ret < 0) {
+		rtio_iodev_sqe_err(iodev_sqe, ret);
+		return;
+	}
+
+	rtio_iodev_sqe_ok(iodev_sqe, 0);
+}
+#endif
+
+static const struct sensor_driver_api l64x0_sensor_api = {
+	.sample_fetch = l64x0_sensor_sample_fetch,
+	.channel_get = l64x0_sensor_channel_get,
+#ifdef CONFIG_SENSOR_ASYNC_API
+	.submit = l64x0_sensor_submit,
+#endif
+	.get_decoder = l64x0_sensor_get_decoder,
+};
+#endif /* CONFIG_L64X0_SENSOR */
+
+uint32_t l64x0_alarm_decode(const struct device *const dev, uint16_t status)
+{
+	const struct l64x0_config *config = dev->config;
+
+	return config->variant->alarms(status);
+}
+
+int l64x0_alarm_callback_set(const struct device *const dev, enum l64x0_alarm alarm,
+			     l64x0_alarm_callback_t cb, void *user_data)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+
+	if (config->flag.port == NULL) {
+		return -ENOTSUP;
+	}
+
+	if (alarm >= L64X0_ALARM_COUNT) {
+		return -EINVAL;
+	}
+
+	/* The work item reads the pair under the device lock */
+	l64x0_lock(dev);
+	data->alarm_cb[alarm] = cb;
+	data->alarm_user_data[alarm] = user_data;
+	l64x0_unlock(dev);
+
+	return 0;
+}
+
+/* One GET_STATUS per FLAG edge, which also releases the pin */
+static void l64x0_alarm_work(struct k_work *work)
+{
+	struct l64x0_data *data = CONTAINER_OF(work, struct l64x0_data, alarm_work);
+	const struct device *dev = data->dev;
+	l64x0_alarm_callback_t cb[L64X0_ALARM_COUNT];
+	void *user_data[L64X0_ALARM_COUNT];
+	uint32_t alarms;
+	uint16_t status;
+	int ret;
+
+	ret = l64x0_get_status(dev, &status);
+	if (ret < 0) {
+		LOG_ERR("%s: failed to read STATUS (%d)", dev->name, ret);
+		return;
+	}
+
+	l64x0_lock(dev);
+	memcpy(cb, data->alarm_cb, sizeof(cb));
+	memcpy(user_data, data->alarm_user_data, sizeof(user_data));
+	l64x0_unlock(dev);
+
+	alarms = l64x0_alarm_decode(dev, status) | atomic_clear(&data->alarm_pending);
+	for (int alarm = 0; alarm < L64X0_ALARM_COUNT; alarm++) {
+		if ((alarms & BIT(alarm)) && cb[alarm] != NULL) {
+			cb[alarm](dev, alarm, status, user_data[alarm]);
+		}
+	}
+}
+
+static void l64x0_flag_isr(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+	struct l64x0_data *data = CONTAINER_OF(cb, struct l64x0_data, flag_cb);
+
+	k_work_submit(&data->alarm_work);
+}
+
+static int l64x0_flag_init(const struct device *dev)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+	int ret;
+
+	if (!gpio_is_ready_dt(&config->flag)) {
+		LOG_ERR("FLAG GPIO %s not ready", config->flag.port->name);
+		return -ENODEV;
+	}
+
+	ret = gpio_pin_configure_dt(&config->flag, GPIO_INPUT);
+	if (ret < 0) {
+		return ret;
+	}
+
+	gpio_init_callback(&data->flag_cb, l64x0_flag_isr, BIT(config->flag.pin));
+	ret = gpio_add_callback_dt(&config->flag, &data->flag_cb);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* FLAG is open drain and may be shared by a whole chain */
+	return gpio_pin_interrupt_configure_dt(&config->flag, GPIO_INT_EDGE_TO_ACTIVE);
+}
+
+#ifdef CONFIG_PM_DEVICE
+#define L64X0_STOP_TIMEOUT	K_SECONDS(1)
+
+/* Every motor, whatever its bus, to find those sharing a STBY line */
+static sys_slist_t l64x0_stby_devs = SYS_SLIST_STATIC_INIT(&l64x0_stby_devs);
+static K_MUTEX_DEFINE(l64x0_stby_devs_lock);
+
+/* The first device on a STBY line owns it */
+static void l64x0_stby_attach(const struct device *dev)
+{
+	const struct gpio_dt_spec *stby = STBY_OF(dev);
+	struct l64x0_data *data = dev->data;
+	struct l64x0_data *other;
+
+	k_mutex_lock(&l64x0_stby_devs_lock, K_FOREVER);
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&l64x0_stby_devs, other, stby_node) {
+		if (STBY_OF(other->dev)->port == stby->port &&
+		    STBY_OF(other->dev)->pin == stby->pin) {
+			data->stby_owner = other->stby_owner;
+			break;
+		}
+	}
+
+	if (data->stby_owner == NULL) {
+		data->stby_owner = dev;
+		k_mutex_init(&data->stby_lock);
+	}
+	((struct l64x0_data *)data->stby_owner->data)->stby_users++;
+	sys_slist_append(&l64x0_stby_devs, &data->stby_node);
+
+	k_mutex_unlock(&l64x0_stby_devs_lock);
+}
+
+/*
+ * The reset latches UVLO on release, nobody should be told: mute FLAG on
+ * every device of the line, each unmutes its own once restored.
+ */
+static void l64x0_stby_mute_flags(const struct device *owner)
+{
+	struct l64x0_data *other;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&l64x0_stby_devs, other, stby_node) {
+		const struct l64x0_config *config = other->dev->config;
+
+		if (other->stby_owner == owner && config->flag.port != NULL) {
+			gpio_pin_interrupt_configure_dt(&config->flag, GPIO_INT_DISABLE);
+		}
+	}
+}
+
+/*
+ * Bridges off and background users stopped, save what the shadow does not
+ * hold, then assert STBY once the last device sharing it is suspended.
+ */
+static int l64x0_pm_suspend(const struct device *dev)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+	struct l64x0_data *owner = data->stby_owner->data;
+	int ret;
+
+#ifdef CONFIG_L64X0_MOTION_QUEUE
+	l64x0_motion_flush(dev);
+#endif
+#ifdef CONFIG_L64X0_STEP_CLOCK
+	if (config->stck.dev != NULL) {
+		l64x0_stck_stop(dev);
+	}
+#endif
+#ifdef CONFIG_L64X0_TELEMETRY
+	data->pm_telemetry = k_work_delayable_is_pending(&data->telemetry_work);
+	l64x0_telemetry_stop(dev);
+#endif
+
+	ret = l64x0_soft_hiz(dev);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (l64x0_wait_idle(dev, L64X0_STOP_TIMEOUT) != 0) {
+		LOG_WRN("%s: still decelerating, forcing HiZ", dev->name);
+		l64x0_hard_hiz(dev);
+	}
+
+	ret = l64x0_getparam(dev, L64x0_ADDR_ABS_POS, &data->pm_abs_pos);
+	if (ret == 0) {
+		ret = l64x0_getparam(dev, L64x0_ADDR_MARK, &data->pm_mark);
+	}
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&owner->stby_lock, K_FOREVER);
+	data->stby_seen = owner->stby_count;
+	if (--owner->stby_users == 0) {
+		l64x0_stby_mute_flags(data->stby_owner);
+		gpio_pin_set_dt(STBY_OF(data->stby_owner), 1);
+		owner->stby_count++;
+	}
+	k_mutex_unlock(&owner->stby_lock);
+
+	return 0;
+}
+
+/*
+ * Release STBY if this is the first device sharing it to resume. A chip
+ * that went through standby is back at its reset values: wait until it is
+ * ready, then rewrite its registers from the shadow.
+ */
+static int l64x0_pm_resume(const struct device *dev)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+	struct l64x0_data *owner = data->stby_owner->data;
+	/* Out of reset the motor is stopped in HiZ */
+	uint32_t status = L64X0_STATUS_HIZ | L64X0_STATUS_BUSY;
+	bool reset;
+	int ret;
+
+	k_mutex_lock(&owner->stby_lock, K_FOREVER);
+	if (owner->stby_users++ == 0) {
+		gpio_pin_set_dt(STBY_OF(data->stby_owner), 0);
+	}
+	reset = (owner->stby_count != data->stby_seen);
+	k_mutex_unlock(&owner->stby_lock);
+
+	if (reset) {
+		ret = l64x0_wait_status(dev, L64X0_STATUS_HIZ | L64X0_STATUS_UVLO,
+					L64X0_READY_TIMEOUT, NULL);
+		if (ret < 0) {
+			LOG_ERR("%s: not ready after standby (%d)", dev->name, ret);
+			return ret;
+		}
+
+		l64x0_lock(dev);
+		ret = l64x0_restore_locked(dev, status);
+		if (ret == 0) {
+			ret = l64x0_setparam_locked(dev, L64x0_ADDR_ABS_POS, data->pm_abs_pos,
+						    &status);
+		}
+		if (ret == 0) {
+			ret = l64x0_setparam_locked(dev, L64x0_ADDR_MARK, data->pm_mark, &status);
+		}
+		l64x0_unlock(dev);
+		if (ret < 0) {
+			return ret;
+		}
+
+		if (config->flag.port != NULL) {
+			gpio_pin_interrupt_configure_dt(&config->flag, GPIO_INT_EDGE_TO_ACTIVE);
+		}
+	}
+
+#ifdef CONFIG_L64X0_TELEMETRY
+	if (data->pm_telemetry) {
+		k_work_schedule(&data->telemetry_work, K_NO_WAIT);
+	}
+#endif
+
+	return 0;
+}
+
+static int l64x0_pm_action(const struct device *dev, enum pm_device_action action)
+{
+	switch (action) {
+	case PM_DEVICE_ACTION_SUSPEND:
+		return l64x0_pm_suspend(dev);
+	case PM_DEVICE_ACTION_RESUME:
+		return l64x0_pm_resume(dev);
+	default:
+		return -ENOTSUP;
+	}
+}
+#endif /* CONFIG_PM_DEVICE */
+
+/* Schedulers of the SPI controllers in use, one per controller */
+static sys_slist_t l64x0_ctrls = SYS_SLIST_STATIC_INIT(&l64x0_ctrls);
+static K_MUTEX_DEFINE(l64x0_ctrls_lock);
+
+#ifdef CONFIG_L64X0_FANOUT
+static struct k_work_q l64x0_workqs[CONFIG_L64X0_FANOUT_CONTROLLERS];
+static K_KERNEL_STACK_ARRAY_DEFINE(l64x0_workq_stacks, CONFIG_L64X0_FANOUT_CONTROLLERS,
+				   CONFIG_L64X0_FANOUT_STACK_SIZE);
+static size_t l64x0_workqs_used;
+
+/* Start a worker for a new controller, registry held */
+static void l64x0_ctrl_workq_start(struct l64x0_ctrl *ctrl)
+{
+	const struct k_work_queue_config cfg = {
+		.name = ctrl->spi->name,
+	};
+	size_t i = l64x0_workqs_used;
+
+	if (i == ARRAY_SIZE(l64x0_workqs)) {
+		LOG_WRN("no worker left for %s, raise CONFIG_L64X0_FANOUT_CONTROLLERS",
+			ctrl->spi->name);
+		return;
+	}
+
+	k_work_queue_start(&l64x0_workqs[i], l64x0_workq_stacks[i],
+			   K_KERNEL_STACK_SIZEOF(l64x0_workq_stacks[i]),
+			   CONFIG_L64X0_FANOUT_PRIORITY, &cfg);
+	ctrl->workq = &l64x0_workqs[i];
+	l64x0_workqs_used++;
+}
+#endif
+
+/* Join the chip select to the scheduler of its controller */
+static void l64x0_ctrl_attach(struct l64x0_bus *bus)
+{
+	struct l64x0_ctrl *ctrl;
+
+	k_mutex_lock(&l64x0_ctrls_lock, K_FOREVER);
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&l64x0_ctrls, ctrl, node) {
+		if (ctrl->spi == bus->spi.bus) {
+			bus->ctrl = ctrl;
+			break;
+		}
+	}
+
+#ifdef CONFIG_L64X0_ASYNC
+	if (sys_slist_is_empty(&l64x0_ctrls)) {
+		const struct k_work_queue_config cfg = {
+			.name = "l64x0_kick",
+		};
+
+		k_work_queue_start(&l64x0_kick_q, l64x0_kick_q_stack,
+				   K_KERNEL_STACK_SIZEOF(l64x0_kick_q_stack),
+				   CONFIG_L64X0_ASYNC_PRIORITY, &cfg);
+	}
+#endif
+
+	if (bus->ctrl == NULL) {
+		ctrl = &bus->ctrl_storage;
+		ctrl->spi = bus->spi.bus;
+#ifdef CONFIG_L64X0_ASYNC
+		sys_slist_init(&ctrl->buses);
+		k_work_init(&ctrl->kick, l64x0_ctrl_async_kick);
+#else
+		k_mutex_init(&ctrl->lock);
+#endif
+#ifdef CONFIG_L64X0_FANOUT
+		l64x0_ctrl_workq_start(ctrl);
+#endif
+		sys_slist_append(&l64x0_ctrls, &ctrl->node);
+		bus->ctrl = ctrl;
+	}
+
+#ifdef CONFIG_L64X0_ASYNC
+	k_spinlock_key_t key = k_spin_lock(&bus->ctrl->lock);
+
+	sys_slist_append(&bus->ctrl->buses, &bus->ctrl_node);
+	k_spin_unlock(&bus->ctrl->lock, key);
+#endif
+
+	k_mutex_unlock(&l64x0_ctrls_lock);
+}
+
+int l64x0_init(const struct device *dev)
+{
+	const struct l64x0_config *config = dev->config;
+	struct l64x0_data *data = dev->data;
+	struct l64x0_bus *bus = config->bus;
+	int ret;
+
+	if (!spi_is_ready_dt(&bus->spi)) {
+		LOG_ERR("SPI bus %s not ready", bus->spi.bus->name);
+		return -ENODEV;
+	}
+
+	/* Chips of a daisy chain share the bus, set it up only once */
+	if (!bus->initialized) {
+		bus->cs_high_cycles = DIV_ROUND_UP((uint64_t)bus->cs_high_ns *
+						   sys_clock_hw_cycles_per_sec(),
+						   NSEC_PER_SEC);
+#ifdef CONFIG_L64X0_ASYNC
+		for (uint8_t slot = 0; slot < bus->length; slot++) {
+			sys_slist_init(&bus->queues[slot]);
+		}
+#endif
+		l64x0_ctrl_attach(bus);
+		bus->initialized = true;
+	}
+
+	k_mutex_init(&data->lock);
+	data->dev = dev;
+	k_work_init(&data->alarm_work, l64x0_alarm_work);
+#ifdef CONFIG_L64X0_MOTION_QUEUE
+	k_msgq_init(&data->motion_q, data->motion_buf, sizeof(struct l64x0_motion),
+		    CONFIG_L64X0_MOTION_QUEUE_DEPTH);
+	k_work_init_delayable(&data->motion_work, l64x0_motion_work);
+	k_poll_signal_init(&data->motion_done);
+#endif
+#ifdef CONFIG_L64X0_TELEMETRY
+	k_work_init_delayable(&data->telemetry_work, l64x0_telemetry_work);
+	/*
+	 * Empty slots claim a sample number no read can ask for until the
+	 * counter wraps, by which time they have all been written.
+	 */
+	for (uint32_t i = 0; i < CONFIG_L64X0_TELEMETRY_DEPTH; i++) {
+		data->ring[i].idx = i - 2 * CONFIG_L64X0_TELEMETRY_DEPTH;
+	}
+#endif
+
+	/* Nothing is known about the registers until they are accessed */
+	atomic_set(&data->dirty, (atomic_val_t)GENMASK(L64x0_ADDR_LAST - 1, 0));
+
+	if (!gpio_is_ready_dt(&config->stby)) {
+		LOG_ERR("STBY GPIO %s not ready", config->stby.port->name);
+		return -ENODEV;
+	}
+
+#ifdef CONFIG_PM_DEVICE
+	l64x0_stby_attach(dev);
+#endif
+
+	/*
+	 * l64x0_stby_pulse() reset every chip at once; most have woken up
+	 * while the ones before them were being set up.
+	 */
+	ret = l64x0_wait_status(dev, L64X0_STATUS_HIZ, L64X0_READY_TIMEOUT, NULL);
+	if (ret < 0) {
+		LOG_ERR("no answer after the reset (%d)", ret);
+		return ret;
+	}
+
+	ret = l64x0_profile_apply(dev, config->init_regs);
+	if (ret < 0) {
+		LOG_ERR("failed to write the boot configuration (%d)", ret);
+		return ret;
+	}
+
+	if (config->busy.port != NULL) {
+		ret = l64x0_busy_init(dev);
+		if (ret < 0) {
+			LOG_ERR("failed to set up the BUSY interrupt (%d)", ret);
+			return ret;
+		}
+	}
+
+#ifdef CONFIG_L64X0_STEP_CLOCK
+	if (config->stck.dev != NULL) {
+		ret = l64x0_stck_init(dev);
+		if (ret < 0) {
+			LOG_ERR("failed to set up the STCK PWM (%d)", ret);
+			return ret;
+		}
+	}
+#endif
+
+	/* Armed after the reset, whose latched UVLO nobody asked for */
+	if (config->flag.port != NULL) {
+		uint16_t status;
+
+		/* FLAG is edge triggered, it would never fire with UVLO still latched */
+		ret = l64x0_get_status(dev, &status);
+		if (ret < 0) {
+			LOG_ERR("failed to clear the latched flags (%d)", ret);
+			return ret;
+		}
+
+		ret = l64x0_flag_init(dev);
+		if (ret < 0) {
+			LOG_ERR("failed to set up the FLAG interrupt (%d)", ret);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+#define L64X0_SPI_OPERATION						\
+	(SPI_OP_MODE_MASTER |						\
+	 SPI_MODE_CPOL |						\
+	 SPI_MODE_CPHA |						\
+	 SPI_TRANSFER_MSB |						\
+	 SPI_WORD_SET(8) |						\
+	 SPI_LOCK_ON)
+
+#define Z_L64X0_BUS_DEFINE(name, node_id, n_chips)			\
+	static uint8_t name##_tx[n_chips];				\
+	static uint8_t name##_rx[n_chips];				\
+	static struct l64x0_cmd *name##_inflight[n_chips];		\
+	IF_ENABLED(CONFIG_L64X0_ASYNC, (				\
+		static sys_slist_t name##_queues[n_chips];		\
+	))								\
+	static const struct spi_buf name##_tx_buf = {			\
+		.buf = name##_tx,					\
+		.len = n_chips,						\
+	};								\
+	static const struct spi_buf name##_rx_buf = {			\
+		.buf = name##_rx,					\
+		.len = n_chips,						\
+	};								\
+	static struct l64x0_bus name = {				\
+		.spi = SPI_DT_SPEC_GET(node_id, L64X0_SPI_OPERATION, 0), \
+		.length = n_chips,					\
+		.tx = name##_tx,					\
+		.rx = name##_rx,					\
+		.tx_set = { .buffers = &name##_tx_buf, .count = 1 },	\
+		.rx_set = { .buffers = &name##_rx_buf, .count = 1 },	\
+		.cs_high_ns = DT_PROP(node_id, cs_high_time_ns),	\
+		.inflight = name##_inflight,				\
+		IF_ENABLED(CONFIG_L64X0_ASYNC, (			\
+			.queues = name##_queues,			\
+		))							\
+	};
+
+#define L64X0_BUS_DEFINE(name, node_id, n_chips)			\
+	Z_L64X0_BUS_DEFINE(name, node_id, n_chips)
+
+#define L64X0_CHAIN_BUS(node_id) UTIL_CAT(l64x0_chain_bus_, DT_DEP_ORD(node_id))
+
+#define L64X0_CHAIN_DEFINE(node_id)					\
+	BUILD_ASSERT(DT_PROP(node_id, chain_length) <= 32,		\
+		     "daisy chains are limited to 32 chips");		\
+	L64X0_BUS_DEFINE(L64X0_CHAIN_BUS(node_id), node_id,		\
+			 DT_PROP(node_id, chain_length))
+
+DT_FOREACH_STATUS_OKAY(st_l64x0_daisy_chain, L64X0_CHAIN_DEFINE)
+
+#define L64X0_CHAIN_MEMBER(n) DT_INST_ON_BUS(n, l64x0_chain)
+
+/* Registers that can be set from devicetree, with their property names */
+#define L64X0_DT_REGS(fn, n)						\
+	fn(n, ACC, acc)							\
+	fn(n, DEC, dec)							\
+	fn(n, MAX_SPEED, max_speed)					\
+	fn(n, KVAL_HOLD, kval_hold)					\
+	fn(n, KVAL_RUN, kval_run)					\
+	fn(n, KVAL_ACC, kval_acc)					\
+	fn(n, KVAL_DEC, kval_dec)					\
+	fn(n, INT_SPEED, int_speed)					\
+	fn(n, ST_SLP, st_slp)						\
+	fn(n, FN_SLP_ACC, fn_slp_acc)					\
+	fn(n, FN_SLP_DEC, fn_slp_dec)					\
+	fn(n, K_THERM, k_therm)						\
+	fn(n, OCD_TH, ocd_th)						\
+	fn(n, STALL_TH, stall_th)					\
+	fn(n, FS_SPD, fs_spd)						\
+	fn(n, STEP_MODE, step_mode)					\
+	fn(n, ALARM_EN, alarm_en)					\
+	fn(n, GATECFG1, gatecfg1)					\
+	fn(n, GATECFG2, gatecfg2)					\
+	fn(n, CONFIG, config)
+
+#define L64X0_DT_REG_VAL(n, reg, prop)					\
+	IF_ENABLED(DT_INST_NODE_HAS_PROP(n, prop),			\
+		   ([L64x0_ADDR_##reg] = DT_INST_PROP(n, prop),))
+
+#define L64X0_DT_REG_MASK(n, reg, prop)					\
+	| (DT_INST_NODE_HAS_PROP(n, prop) ? BIT(L64x0_ADDR_##reg) : 0)
+
+#define L64X0_DT_INIT_REGS_DEFINE(n, chip)				\
+	static const struct l64x0_profile l64x0_init_regs_##chip##_##n = { \
+		.regs = {						\
+			L64X0_DT_REGS(L64X0_DT_REG_VAL, n)		\
+			IF_ENABLED(DT_INST_NODE_HAS_PROP(n, min_speed),	\
+				   ([L64x0_ADDR_MIN_SPEED] =		\
+				    DT_INST_PROP(n, min_speed) |	\
+				    (DT_INST_PROP(n, low_speed_optimization) ? \
+				     L64X0_MIN_SPEED_LSPD_OPT : 0),))	\
+		},							\
+		.mask = 0 L64X0_DT_REGS(L64X0_DT_REG_MASK, n)		\
+			L64X0_DT_REG_MASK(n, MIN_SPEED, min_speed),	\
+	};
+
+#define L64X0_STBY_PIN(node) GPIO_DT_SPEC_GET(node, stby_gpios),
+
+/* Every STBY line, in chips sharing one once per chip */
+static const struct gpio_dt_spec l64x0_stby_pins[] = {
+	DT_FOREACH_STATUS_OKAY(st_l6470, L64X0_STBY_PIN)
+	DT_FOREACH_STATUS_OKAY(st_l6480, L64X0_STBY_PIN)
+};
+
+/*
+ * Reset all chips together just before the first device init, so that
+ * they come out of reset in parallel rather than one after the other.
+ */
+static int l64x0_stby_pulse(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(l64x0_stby_pins); i++) {
+		if (gpio_is_ready_dt(&l64x0_stby_pins[i])) {
+			gpio_pin_configure_dt(&l64x0_stby_pins[i], GPIO_OUTPUT_ACTIVE);
+		}
+	}
+
+	/* tSTBY,min */
+	k_busy_wait(10);
+
+	for (size_t i = 0; i < ARRAY_SIZE(l64x0_stby_pins); i++) {
+		if (gpio_is_ready_dt(&l64x0_stby_pins[i])) {
+			gpio_pin_set_dt(&l64x0_stby_pins[i], 0);
+		}
+	}
+
+	return 0;
+}
+
+SYS_INIT(l64x0_stby_pulse, POST_KERNEL, CONFIG_L64X0_INIT_PRIORITY - 1);
+
+#define L64X0_INIT(n, chip)						\
+	COND_CODE_1(L64X0_CHAIN_MEMBER(n),				\
+		    (BUILD_ASSERT(DT_INST_REG_ADDR(n) <			\
+				  DT_PROP(DT_INST_PARENT(n), chain_length), \
+				  "chain position out of range");),	\
+		    (L64X0_BUS_DEFINE(l64x0_bus_##chip##_##n,		\
+				      DT_DRV_INST(n), 1)))		\
+									\
+	L64X0_DT_INIT_REGS_DEFINE(n, chip)				\
+									\
+	static const struct l64x0_config l64x0_cfg_##chip##_##n = {	\
+		.variant = &chip##_variant,				\
+		.bus = COND_CODE_1(L64X0_CHAIN_MEMBER(n),		\
+				   (&L64X0_CHAIN_BUS(DT_INST_PARENT(n))), \
+				   (&l64x0_bus_##chip##_##n)),		\
+		.position = COND_CODE_1(L64X0_CHAIN_MEMBER(n),		\
+					(DT_INST_REG_ADDR(n)), (0)),	\
+		.stby = GPIO_DT_SPEC_INST_GET(n, stby_gpios),		\
+		.flag = GPIO_DT_SPEC_INST_GET_OR(n, flag_gpios, {0}),	\
+		.busy = GPIO_DT_SPEC_INST_GET_OR(n, busy_gpios, {0}),	\
+		IF_ENABLED(CONFIG_L64X0_STEP_CLOCK, (			\
+			.stck = PWM_DT_SPEC_INST_GET_OR(n, {0}),	\
+		))							\
+		.init_regs = &l64x0_init_regs_##chip##_##n,		\
+	};								\
+									\
+	static struct l64x0_data l64x0_data_##chip##_##n;		\
+									\
+	PM_DEVICE_DT_INST_DEFINE(n, l64x0_pm_action);			\
+									\
+	DEVICE_DT_INST_DEFINE(n,					\
+			      &l64x0_init,				\
+			      PM_DEVICE_DT_INST_GET(n),			\
+			      &l64x0_data_##chip##_##n,			\
+			      &l64x0_cfg_##chip##_##n,			\
+			      POST_KERNEL,				\
+			      CONFIG_L64X0_INIT_PRIORITY,		\
+			      COND_CODE_1(CONFIG_L64X0_SENSOR,		\
+					  (&l64x0_sensor_api), (NULL)));
+
+/* Both chips are served by this driver, each compatible with its own tables */
+#define DT_DRV_COMPAT st_l6470
+#define L64X0_INIT_L6470(n) L64X0_INIT(n, l6470)
+DT_INST_FOREACH_STATUS_OKAY(L64X0_INIT_L6470)
+#undef DT_DRV_COMPAT
 
-DT_INST_FOREACH_STATUS_OKAY(L64X0_INIT)
+#define DT_DRV_COMPAT st_l6480
+#define L64X0_INIT_L6480(n) L64X0_INIT(n, l6480)
+DT_INST_FOREACH_STATUS_OKAY(L64X0_INIT_L6480)
+#undef DT_DRV_COMPAT
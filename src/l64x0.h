@@ -4,9 +4,15 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#ifndef L64X0_H_
+#define L64X0_H_
+
 #include <zephyr/sys/util.h>
+#include <zephyr/sys/slist.h>
 #include <zephyr/device.h>
+#include <errno.h>
 
+/* Register IDs, the address on the chip is looked up per device */
 enum L64x0Addr {
 	L64x0_ADDR_ABS_POS    = 0x01,
 	L64x0_ADDR_EL_POS     = 0x02,
@@ -31,24 +37,65 @@ enum L64x0Addr {
 	L64x0_ADDR_FS_SPD     = 0x15,
 	L64x0_ADDR_STEP_MODE  = 0x16,
 	L64x0_ADDR_ALARM_EN   = 0x17,
-#if IS_ENABLED(CONFIG_L6470)
-	L64x0_ADDR_CONFIG     = 0x18,
-	L64x0_ADDR_STATUS     = 0x19,
-#elif IS_ENABLED(CONFIG_L6480)
+	/* The L6470 has no GATECFGx and has CONFIG/STATUS at 0x18/0x19 */
 	L64x0_ADDR_GATECFG1   = 0x18,
 	L64x0_ADDR_GATECFG2   = 0x19,
 	L64x0_ADDR_CONFIG     = 0x1a,
 	L64x0_ADDR_STATUS     = 0x1b,
-#endif
 	L64x0_ADDR_LAST,
 };
 
 /* Minimum speed */
-#define L64X0_MIN_SPEED_LSPD_OPT (0x800)
+#define L64X0_MIN_SPEED_LSPD_OPT BIT(12)
 
 /* KVAL_X */
 #define L64X0_KVAL_X_256TH(x) ((x) & GENMASK(7, 0))
 
+/*
+ * Physical units to register values, for the 250 ns tick of both chips.
+ * Speeds are in full steps/s, accelerations in full steps/s^2. Each is a
+ * multiplication by a Q24 constant and a shift: constant arguments fold
+ * at compile time, others cost a 32x32 to 64 bit multiply, with neither
+ * division nor floating point. Results saturate to the register width.
+ * Arguments may be evaluated more than once.
+ */
+#define Z_L64X0_Q24_SPEED(e) ((BIT64((e) + 24) + 2000000U) / 4000000U)
+#define Z_L64X0_Q24_ACC ((BIT64(60) + 500000000000ULL) / 1000000000000ULL)
+#define Z_L64X0_Q24(x, k, round) (((uint64_t)(x) * (k) + (round)) >> 24)
+#define Z_L64X0_SAT(val, bits) ((uint32_t)MIN((val), BIT64(bits) - 1))
+
+/* SPEED and the RUN argument: sps * 2^28 * tick */
+#define L64X0_SPEED(sps) Z_L64X0_SAT(Z_L64X0_Q24(sps, Z_L64X0_Q24_SPEED(28), BIT(23)), 20)
+/* ACC and DEC: sps2 * 2^40 * tick^2 */
+#define L64X0_ACC(sps2) Z_L64X0_SAT(Z_L64X0_Q24(sps2, Z_L64X0_Q24_ACC, BIT(23)), 12)
+/* MAX_SPEED: sps * 2^18 * tick */
+#define L64X0_MAX_SPEED(sps) Z_L64X0_SAT(Z_L64X0_Q24(sps, Z_L64X0_Q24_SPEED(18), BIT(23)), 10)
+/* MIN_SPEED without LSPD_OPT: sps * 2^24 * tick */
+#define L64X0_MIN_SPEED(sps) Z_L64X0_SAT(Z_L64X0_Q24(sps, Z_L64X0_Q24_SPEED(24), BIT(23)), 12)
+/* INT_SPEED: sps * 2^26 * tick */
+#define L64X0_INT_SPEED(sps) Z_L64X0_SAT(Z_L64X0_Q24(sps, Z_L64X0_Q24_SPEED(26), BIT(23)), 14)
+/* FS_SPD: sps * 2^18 * tick - 0.5, rounded, is the truncated product */
+#define L64X0_FS_SPD(sps) Z_L64X0_SAT(Z_L64X0_Q24(sps, Z_L64X0_Q24_SPEED(18), 0), 10)
+/* KVAL_HOLD, _RUN, _ACC and _DEC in percent of Vs */
+#define L64X0_KVAL(pct) Z_L64X0_SAT(((uint32_t)(pct) * 256U + 50U) / 100U, 8)
+
+/* SPEED back to full steps/s, rounded down */
+#define L64X0_SPEED_TO_SPS(val) ((uint32_t)(((uint64_t)(val) * 15625U) >> 20))
+
+/* Thresholds of (code + 1) * num / den units, rounded to the nearest code */
+#define Z_L64X0_TH(x, num, den, bits)					\
+	Z_L64X0_SAT(((uint32_t)(x) * (den) + (num) / 2U) / (num) -	\
+		    (((uint32_t)(x) * (den) + (num) / 2U) / (num) > 0), bits)
+
+/* L6470 OCD_TH in mA, 375 mA steps */
+#define L6470_OCD_TH(ma) Z_L64X0_TH(ma, 375U, 1U, 4)
+/* L6470 STALL_TH in mA, 31.25 mA steps */
+#define L6470_STALL_TH(ma) Z_L64X0_TH(ma, 125U, 4U, 7)
+/* L6480 OCD_TH in mV across the power MOSFET, 31.25 mV steps */
+#define L6480_OCD_TH(mv) Z_L64X0_TH(mv, 125U, 4U, 5)
+/* L6480 STALL_TH in mV across the power MOSFET, 31.25 mV steps */
+#define L6480_STALL_TH(mv) Z_L64X0_TH(mv, 125U, 4U, 5)
+
 /* Overcurrent Threshold */
 #define L6470_OCD_TH_375_mV  (0)
 #define L6470_OCD_TH_750_mV  (1)
@@ -357,7 +404,7 @@ enum L64x0Addr {
 #define L6470_STATUS_SW_F		BIT(2)
 #define L6470_STATUS_BUSY		BIT(1)
 #define L6470_STATUS_HiZ		BIT(0)
-#define L6470_STATUS_HIZ		STATUS_HiZ
+#define L6470_STATUS_HIZ		L6470_STATUS_HiZ
 
 #define L6480_STATUS_STEP_LOSS_B	BIT(15)
 #define L6480_STATUS_STEP_LOSS_A	BIT(14)
@@ -373,63 +420,462 @@ enum L64x0Addr {
 #define L6480_STATUS_SW_F		BIT(2)
 #define L6480_STATUS_BUSY		BIT(1)
 #define L6480_STATUS_HiZ		BIT(0)
-#define L6480_STATUS_HIZ		STATUS_HiZ
-
-#if IS_ENABLED(CONFIG_L6470)
-#define L64X0_STATUS_STEP_LOSS_B	L6470_STATUS_STEP_LOSS_B
-#define L64X0_STATUS_STEP_LOSS_A	L6470_STATUS_STEP_LOSS_A
-#define L64X0_STATUS_OCD		L6470_STATUS_OCD
-#define L64X0_STATUS_UVLO		L6470_STATUS_UVLO
-#define L64X0_STATUS_MOT_STATUS(x)	L6470_STATUS_MOT_STATUS(x)
-#define L64X0_STATUS_DIR		L6470_STATUS_DIR
-#define L64X0_STATUS_SW_EVN		L6470_STATUS_SW_EVN
-#define L64X0_STATUS_SW_F		L6470_STATUS_SW_F
-#define L64X0_STATUS_BUSY		L6470_STATUS_BUSY
-#define L64X0_STATUS_HiZ		L6470_STATUS_HiZ
-#define L64X0_STATUS_HIZ		L6470_STATUS_HIZ
-#elif IS_ENABLED(CONFIG_L6480)
-#define L64X0_STATUS_STEP_LOSS_B	L6480_STATUS_STEP_LOSS_B
-#define L64X0_STATUS_STEP_LOSS_A	L6480_STATUS_STEP_LOSS_A
-#define L64X0_STATUS_OCD		L6480_STATUS_OCD
-#define L64X0_STATUS_UVLO		L6480_STATUS_UVLO
-#define L64X0_STATUS_MOT_STATUS(x)	L6480_STATUS_MOT_STATUS(x)
-#define L64X0_STATUS_DIR		L6480_STATUS_DIR
-#define L64X0_STATUS_SW_EVN		L6480_STATUS_SW_EVN
-#define L64X0_STATUS_SW_F		L6480_STATUS_SW_F
-#define L64X0_STATUS_BUSY		L6480_STATUS_BUSY
-#define L64X0_STATUS_HiZ		L6480_STATUS_HiZ
-#define L64X0_STATUS_HIZ		L6480_STATUS_HIZ
-#endif
+#define L6480_STATUS_HIZ		L6480_STATUS_HiZ
+
+/* Status bits at the same place on both chips */
+#define L64X0_STATUS_UVLO		BIT(9)
+#define L64X0_STATUS_MOT_STATUS(x)	(((x) << 5) & GENMASK(6, 5))
+#define L64X0_STATUS_DIR		BIT(4)
+#define L64X0_STATUS_SW_EVN		BIT(3)
+#define L64X0_STATUS_SW_F		BIT(2)
+#define L64X0_STATUS_BUSY		BIT(1)
+#define L64X0_STATUS_HiZ		BIT(0)
+#define L64X0_STATUS_HIZ		L64X0_STATUS_HiZ
 
+/*
+ * Every call returns 0 or a negative errno; values read from the chip come
+ * back through a pointer. A failed transfer may leave the chip in the
+ * middle of a command, so the driver recovers before returning the error:
+ * it flushes the chip with NOPs, reads and clears STATUS, and rewrites
+ * the registers written or read so far, except those the motor state
+ * forbids, which are read again before their next use. Registers the
+ * chip only takes with the motor stopped (ACC, DEC, MIN_SPEED, ALARM_EN)
+ * or in HiZ (STEP_MODE, CONFIG, INT_SPEED, ST_SLP, FN_SLP_x, GATECFGx)
+ * cost one STATUS read per call, or per profile, and fail with -EBUSY
+ * without being sent in any other state.
+ */
 int l64x0_nop(const struct device *const dev);
-void l64x0_setparam(const struct device *const dev, uint8_t param, uint32_t val);
-int l64x0_getparam(const struct device *const dev, uint8_t param);
+int l64x0_setparam(const struct device *const dev, uint8_t param, uint32_t val);
+int l64x0_getparam(const struct device *const dev, uint8_t param, uint32_t *val);
 int l64x0_run(const struct device *const dev, int speed);
 int l64x0_move(const struct device *const dev, int n_step);
+/* Shortest way to an ABS_POS value, 22 bits two's complement */
+int l64x0_goto(const struct device *const dev, int32_t abs_pos);
+int l64x0_goto_dir(const struct device *const dev, int32_t abs_pos, bool forward);
+int l64x0_go_home(const struct device *const dev);
+int l64x0_go_mark(const struct device *const dev);
+int l64x0_reset_pos(const struct device *const dev);
+
+/* What GO_UNTIL and RELEASE_SW do with ABS_POS when SW acts */
+enum l64x0_sw_action {
+	L64X0_SW_RESET_POS,
+	L64X0_SW_MARK,
+};
+
+/* Run at speed, in signed SPEED units, until SW closes, then soft stop */
+int l64x0_go_until(const struct device *const dev, enum l64x0_sw_action act, int speed);
+/* Move at MIN_SPEED, at least about 5 steps/s, until SW opens, then stop */
+int l64x0_release_sw(const struct device *const dev, enum l64x0_sw_action act, bool forward);
+
+/*
+ * Home on the SW input without software polling: GO_UNTIL at speed, then
+ * RELEASE_SW back off the switch, where ABS_POS is reset or copied to MARK.
+ * Waits for both motions like l64x0_wait_idle(), within timeout in all.
+ * Returns -EIO if the approach ended without a switch turn-on event.
+ */
+int l64x0_home(const struct device *const dev, int speed, enum l64x0_sw_action act,
+	       k_timeout_t timeout);
 int l64x0_reset_device(const struct device *const dev);
 int l64x0_soft_stop(const struct device *const dev);
 int l64x0_hard_stop(const struct device *const dev);
 int l64x0_soft_hiz(const struct device *const dev);
 int l64x0_hard_hiz(const struct device *const dev);
-int l64x0_get_status(const struct device *const dev);
+/* Read STATUS, clearing the latched flags and releasing FLAG */
+int l64x0_get_status(const struct device *const dev, uint16_t *status);
+
+struct l64x0_error_counters {
+	/* Failed SPI transfers */
+	uint32_t bus;
+	/* WRONG_CMD or CMD_ERROR found latched after one */
+	uint32_t cmd;
+	/* Recoveries that completed, and those that failed in turn */
+	uint32_t recovered;
+	uint32_t unrecovered;
+};
+
+/* Counts since boot */
+void l64x0_error_counters_get(const struct device *const dev,
+			      struct l64x0_error_counters *counters);
+
+/*
+ * Enter step-clock mode, where the motor takes one microstep per rising
+ * edge on STCK until the next motion command. Ignored unless stopped.
+ */
+int l64x0_step_clock(const struct device *const dev, bool forward);
+
+enum l64x0_variant_id {
+	L64X0_VARIANT_L6470,
+	L64X0_VARIANT_L6480,
+};
+
+enum l64x0_variant_id l64x0_variant(const struct device *const dev);
+
+/*
+ * Wait until the supply is above the UVLO threshold, e.g. for the charge
+ * pump after power up, polling STATUS. Alarms the polling clears still
+ * reach their callbacks when flag-gpios is wired. Returns -ETIMEDOUT on
+ * timeout.
+ */
+int l64x0_wait_ready(const struct device *const dev, k_timeout_t timeout);
+
+/*
+ * Wait until the motion in progress is over. Sleeps on the BUSY pin when
+ * busy-gpios is wired, in BUSY mode (SYNC_EN cleared); polls STATUS
+ * otherwise. Returns -EAGAIN on timeout.
+ */
+int l64x0_wait_idle(const struct device *const dev, k_timeout_t timeout);
+
+/*
+ * Raised on each busy to idle edge of the BUSY pin, for k_poll(). Reset it
+ * before starting the motion to wait for. NULL without busy-gpios.
+ */
+struct k_poll_signal *l64x0_idle_signal(const struct device *const dev);
+
+#ifdef CONFIG_L64X0_MOTION_QUEUE
+enum l64x0_motion_op {
+	L64X0_MOTION_MOVE,
+	L64X0_MOTION_GOTO,
+	L64X0_MOTION_RUN,
+	L64X0_MOTION_SOFT_STOP,
+	L64X0_MOTION_HARD_STOP,
+};
+
+/*
+ * Motion queue entry. arg is the signed step count of a MOVE, the ABS_POS
+ * of a GOTO or the signed SPEED of a RUN. The optional profile is written
+ * just before the command and must stay valid until then.
+ */
+struct l64x0_motion {
+	enum l64x0_motion_op op;
+	int32_t arg;
+	const struct l64x0_profile *profile;
+};
+
+/*
+ * Queue a motion, to be sent as soon as the one before has ended: from
+ * the BUSY interrupt through the system work queue with busy-gpios, by
+ * polling STATUS otherwise. A RUN ends once at speed, so only a RUN, a
+ * GOTO or a stop may follow it. Waits up to timeout for room.
+ */
+int l64x0_motion_enqueue(const struct device *const dev, const struct l64x0_motion *motion,
+			 k_timeout_t timeout);
+
+/*
+ * Drop the queued entries, the motion in progress goes on. Waiters on
+ * l64x0_motion_signal() are released with -ECANCELED.
+ */
+int l64x0_motion_flush(const struct device *const dev);
+
+/*
+ * Raised with 0 when the queue has run dry and the last motion ended, or
+ * with the error or -ECANCELED that flushed the queue. Reset by each
+ * enqueue.
+ */
+struct k_poll_signal *l64x0_motion_signal(const struct device *const dev);
+#endif
+
+#ifdef CONFIG_L64X0_STEP_CLOCK
+/* Pulse train segment: steps rising edges on STCK, period_ns apart */
+struct l64x0_stck_segment {
+	uint32_t period_ns;
+	uint32_t steps;
+};
+
+/*
+ * Turn a velocity profile, a speed in microsteps per second every dt_us,
+ * into at most n segments, returning how many. Samples at rest are
+ * skipped, so the profile should not pause.
+ */
+size_t l64x0_stck_table(const uint32_t *sps, size_t n, uint32_t dt_us,
+			struct l64x0_stck_segment *table);
+
+/*
+ * Enter step-clock mode and play a table on the pwms channel. The PWM
+ * makes the steps, the CPU only switches segments. The table is used in
+ * place until the signal below is raised.
+ *
+ * Steps are not counted: a kernel timer ends each segment, after
+ * period_ns * steps rounded up to the next system tick plus the timer
+ * ISR latency. A segment can thus emit up to (tick + latency) / period_ns
+ * + 1 extra pulses, and these errors add up over the table. Where the
+ * step count must be exact, read ABS_POS once the table is over and
+ * correct it with l64x0_move().
+ */
+int l64x0_stck_start(const struct device *const dev, bool forward,
+		     const struct l64x0_stck_segment *table, size_t n);
+
+/*
+ * Steady STCK rate after l64x0_step_clock(), 0 for none, e.g. to follow
+ * an encoder. Ends a table being played.
+ */
+int l64x0_stck_set_period(const struct device *const dev, uint32_t period_ns);
+int l64x0_stck_stop(const struct device *const dev);
+
+/* Raised with 0 at the end of a table, -ECANCELED if ended early. NULL without pwms. */
+struct k_poll_signal *l64x0_stck_signal(const struct device *const dev);
+#endif
+
+#ifdef CONFIG_L64X0_TELEMETRY
+/*
+ * Telemetry. Values are stored by ascending register address, only for
+ * the registers in mask; l64x0_sample_value() picks one out.
+ */
+struct l64x0_sample {
+	int64_t uptime_ticks;
+	uint32_t mask;
+	uint32_t val[CONFIG_L64X0_TELEMETRY_MAX_REGS];
+};
+
+/* Read the registers in mask every period, restarting the sampler if running */
+int l64x0_telemetry_start(const struct device *const dev, uint32_t mask, k_timeout_t period);
+int l64x0_telemetry_stop(const struct device *const dev);
+
+/*
+ * Copy a sample without touching the bus, age 0 being the latest one.
+ * Returns -ENODATA if it was never taken or already overwritten.
+ */
+int l64x0_telemetry_read(const struct device *const dev, uint32_t age,
+			 struct l64x0_sample *sample);
+
+static inline int l64x0_sample_value(const struct l64x0_sample *sample, uint8_t param,
+				     uint32_t *val)
+{
+	if (!(sample->mask & BIT(param))) {
+		return -ENOENT;
+	}
+
+	*val = sample->val[POPCOUNT(sample->mask & (BIT(param) - 1))];
+
+	return 0;
+}
+#endif /* CONFIG_L64X0_TELEMETRY */
+
+#ifdef CONFIG_L64X0_STATS
+/* Command kinds, whatever their direction, register or switch action */
+enum l64x0_op {
+	L64X0_OP_NOP,
+	L64X0_OP_SET_PARAM,
+	L64X0_OP_GET_PARAM,
+	L64X0_OP_MOVE,
+	L64X0_OP_RUN,
+	L64X0_OP_STEP_CLOCK,
+	L64X0_OP_GOTO,
+	L64X0_OP_GOTO_DIR,
+	L64X0_OP_GO_HOME,
+	L64X0_OP_GO_MARK,
+	L64X0_OP_GO_UNTIL,
+	L64X0_OP_RELEASE_SW,
+	L64X0_OP_SOFT_HIZ,
+	L64X0_OP_HARD_HIZ,
+	L64X0_OP_SOFT_STOP,
+	L64X0_OP_HARD_STOP,
+	L64X0_OP_RESET_DEVICE,
+	L64X0_OP_GET_STATUS,
+	L64X0_OP_RESET_POS,
+	L64X0_OP_COUNT,
+};
+
+/*
+ * Blocking commands of one kind, timed in hardware cycles from the start
+ * of the transfer to its end. Bucket i of the histogram counts latencies
+ * of 2^i up to 2^(i+1) - 1 cycles, the last one everything longer.
+ */
+struct l64x0_op_stats {
+	uint32_t count;
+	/* Bytes of the device's command, not counting NOPs of the chain */
+	uint32_t bytes;
+	uint32_t min_cycles;
+	uint32_t max_cycles;
+	/* Time on the bus, against k_cycle_get_64() for utilisation */
+	uint64_t total_cycles;
+	uint32_t hist[CONFIG_L64X0_STATS_HIST_BUCKETS];
+};
+
+int l64x0_stats_get(const struct device *const dev, enum l64x0_op op,
+		    struct l64x0_op_stats *stats);
+void l64x0_stats_reset(const struct device *const dev);
+#endif /* CONFIG_L64X0_STATS */
+
+#ifdef CONFIG_L64X0_SENSOR
+#include <zephyr/drivers/sensor.h>
+
+/*
+ * Sensor channels, read together from one snapshot. STATUS is read
+ * without clearing its latched flags.
+ */
+enum l64x0_sensor_channel {
+	/* Steps per second, negative in reverse */
+	L64X0_CHAN_SPEED = SENSOR_CHAN_PRIV_START,
+	/* ABS_POS, in microsteps */
+	L64X0_CHAN_POSITION,
+	/* ADC_OUT, raw 5 bit conversion */
+	L64X0_CHAN_ADC_OUT,
+	/* 0 normal, 1 warning, 2 shutdown */
+	L64X0_CHAN_THERMAL,
+	/* Bitmap of the latched alarms, by enum l64x0_alarm */
+	L64X0_CHAN_FAULTS,
+};
+#endif /* CONFIG_L64X0_SENSOR */
+
+/* Faults and events latched in STATUS, the same on both chips */
+enum l64x0_alarm {
+	L64X0_ALARM_OCD,
+	L64X0_ALARM_TH_SD,
+	L64X0_ALARM_TH_WRN,
+	L64X0_ALARM_UVLO,
+	/* L6480 only */
+	L64X0_ALARM_UVLO_ADC,
+	L64X0_ALARM_STEP_LOSS_A,
+	L64X0_ALARM_STEP_LOSS_B,
+	L64X0_ALARM_SW_EVN,
+	/* WRONG_CMD or NOTPERF_CMD on the L6470 */
+	L64X0_ALARM_CMD_ERROR,
+	L64X0_ALARM_COUNT,
+};
+
+typedef void (*l64x0_alarm_callback_t)(const struct device *dev, enum l64x0_alarm alarm,
+				       uint16_t status, void *user_data);
+
+/* Bitmap of the alarms, by enum l64x0_alarm, set in a STATUS value */
+uint32_t l64x0_alarm_decode(const struct device *const dev, uint16_t status);
+
+/*
+ * Call cb from the system work queue each time alarm is found set after
+ * the FLAG pin asserts; NULL unregisters. Which faults assert FLAG is set
+ * by ALARM_EN. Needs flag-gpios, and reading STATUS elsewhere clears the
+ * latched bits before the driver sees them.
+ */
+int l64x0_alarm_callback_set(const struct device *const dev, enum l64x0_alarm alarm,
+			     l64x0_alarm_callback_t cb, void *user_data);
+
+/* Commands for several chips of one daisy chain, clocked out in the same frames */
+#define L64X0_CMD_MAX_BYTES (4)
+
+struct l64x0_cmd;
+
+typedef void (*l64x0_callback_t)(const struct device *dev, struct l64x0_cmd *cmd,
+				 int status, void *user_data);
+
+struct l64x0_cmd {
+	const struct device *dev;
+	uint8_t len;
+	bool read;
+	uint8_t tx[L64X0_CMD_MAX_BYTES];
+	uint8_t rx[L64X0_CMD_MAX_BYTES];
+	/* Asynchronous completion */
+	sys_snode_t node;
+	l64x0_callback_t cb;
+	void *user_data;
+};
+
+void l64x0_cmd_nop(struct l64x0_cmd *cmd, const struct device *const dev);
+int l64x0_cmd_setparam(struct l64x0_cmd *cmd, const struct device *const dev, uint8_t param, uint32_t val);
+int l64x0_cmd_getparam(struct l64x0_cmd *cmd, const struct device *const dev, uint8_t param);
+void l64x0_cmd_run(struct l64x0_cmd *cmd, const struct device *const dev, int speed);
+void l64x0_cmd_move(struct l64x0_cmd *cmd, const struct device *const dev, int n_step);
+void l64x0_cmd_goto(struct l64x0_cmd *cmd, const struct device *const dev, int32_t abs_pos);
+void l64x0_cmd_goto_dir(struct l64x0_cmd *cmd, const struct device *const dev, int32_t abs_pos,
+			bool forward);
+void l64x0_cmd_go_until(struct l64x0_cmd *cmd, const struct device *const dev,
+			enum l64x0_sw_action act, int speed);
+void l64x0_cmd_release_sw(struct l64x0_cmd *cmd, const struct device *const dev,
+			  enum l64x0_sw_action act, bool forward);
+void l64x0_cmd_go_home(struct l64x0_cmd *cmd, const struct device *const dev);
+void l64x0_cmd_go_mark(struct l64x0_cmd *cmd, const struct device *const dev);
+void l64x0_cmd_reset_pos(struct l64x0_cmd *cmd, const struct device *const dev);
+void l64x0_cmd_step_clock(struct l64x0_cmd *cmd, const struct device *const dev, bool forward);
+void l64x0_cmd_soft_stop(struct l64x0_cmd *cmd, const struct device *const dev);
+void l64x0_cmd_hard_stop(struct l64x0_cmd *cmd, const struct device *const dev);
+void l64x0_cmd_soft_hiz(struct l64x0_cmd *cmd, const struct device *const dev);
+void l64x0_cmd_hard_hiz(struct l64x0_cmd *cmd, const struct device *const dev);
+void l64x0_cmd_get_status(struct l64x0_cmd *cmd, const struct device *const dev);
+int l64x0_cmd_result(const struct l64x0_cmd *cmd);
+
+/*
+ * Send one command to each of the given chips, which must all sit on the
+ * same daisy chain. Chips of the chain without a command receive NOPs.
+ */
+int l64x0_chain_submit(struct l64x0_cmd *cmds, size_t n);
+
+/*
+ * Start one command per device on any mix of chip selects and chains,
+ * e.g. run, move or stop commands for coordinated axes. All but the last
+ * byte of every command is staged first, then the last byte times of the
+ * chip selects are clocked back to back; chips of one chain execute on
+ * the same CS edge. skew_ns, if not NULL, gets the time between the first
+ * and the last of these edges. With CONFIG_L64X0_ASYNC the devices must
+ * share one chip select.
+ */
+int l64x0_group_submit(struct l64x0_cmd *cmds, size_t n, uint32_t *skew_ns);
+
+/*
+ * Send one command per device, with the share of each SPI controller sent
+ * concurrently: from the controller's worker with CONFIG_L64X0_FANOUT, or
+ * from its completion interrupt with CONFIG_L64X0_ASYNC; controller after
+ * controller otherwise. Chips of one chain share a frame, as with
+ * l64x0_chain_submit(). Returns when all are done, with an error if any.
+ */
+int l64x0_fanout(struct l64x0_cmd *cmds, size_t n);
+
+/*
+ * Queue a command without waiting for it. The command must stay valid
+ * until cb runs, usually from the SPI completion interrupt, with the
+ * transfer status; GET_PARAM and GET_STATUS data is then available
+ * through l64x0_cmd_result(). Commands queued for different chips of a
+ * daisy chain share frames; chip selects of one SPI controller take
+ * turns, one frame each.
+ */
+int l64x0_submit(struct l64x0_cmd *cmd, l64x0_callback_t cb, void *user_data);
+
+/*
+ * A set of register values, e.g. one per motion regime. Applying it only
+ * sends the registers that differ from what the device already holds.
+ * Only host-owned registers can be part of a profile.
+ */
+struct l64x0_profile {
+	uint32_t regs[L64x0_ADDR_LAST];
+	uint32_t mask;
+};
+
+static inline void l64x0_profile_set(struct l64x0_profile *profile, uint8_t param, uint32_t val)
+{
+	profile->regs[param] = val;
+	profile->mask |= BIT(param);
+}
+
+int l64x0_profile_apply(const struct device *const dev, const struct l64x0_profile *profile);
+int l64x0_profile_get(const struct device *const dev, struct l64x0_profile *profile);
+
+/*
+ * Registers read back to back under one lock, so they describe the same
+ * instant. Values are indexed by register ID, valid for the bits in mask.
+ */
+struct l64x0_snapshot {
+	int64_t uptime_ticks;
+	uint32_t mask;
+	uint32_t regs[L64x0_ADDR_LAST];
+};
+
+int l64x0_snapshot(const struct device *const dev, uint32_t mask,
+		   struct l64x0_snapshot *snapshot);
 
 #define GEN_SETPARAM(fname, pname)					\
-	static inline void l64x0_setparam_ ##fname(const struct device *const dev, uint32_t val) \
+	static inline int l64x0_setparam_ ##fname(const struct device *const dev, uint32_t val) \
 	{								\
-		l64x0_setparam(dev, L64x0_ADDR_ ##pname, val); \
+		return l64x0_setparam(dev, L64x0_ADDR_ ##pname, val);	\
 	}
 
 GEN_SETPARAM(acc, ACC)
 GEN_SETPARAM(dec, DEC)
 GEN_SETPARAM(max_speed, MAX_SPEED)
-static inline void l64x0_setparam_min_speed(const struct device *const dev, uint32_t speed, bool lspd_opt)
+static inline int l64x0_setparam_min_speed(const struct device *const dev, uint32_t speed, bool lspd_opt)
 {
 	uint32_t val = speed & GENMASK(11, 0);
 
 	if (lspd_opt)
 		val |= L64X0_MIN_SPEED_LSPD_OPT;
 
-	l64x0_setparam(dev, L64x0_ADDR_MIN_SPEED, val);
+	return l64x0_setparam(dev, L64x0_ADDR_MIN_SPEED, val);
 }
 GEN_SETPARAM(kval_hold, KVAL_HOLD)
 GEN_SETPARAM(kval_run, KVAL_RUN)
@@ -446,20 +892,15 @@ GEN_SETPARAM(stall_th, STALL_TH)
 GEN_SETPARAM(fs_spd, FS_SPD)
 GEN_SETPARAM(step_mode, STEP_MODE)
 GEN_SETPARAM(alarm_en, ALARM_EN)
-#if IS_ENABLED(CONFIG_L6480)
 GEN_SETPARAM(gatecfg1, GATECFG1)
 GEN_SETPARAM(gatecfg2, GATECFG2)
-#else
-static inline void l64x0_setparam_gatecfg1(const struct device *const dev, uint32_t val) { }
-static inline void l64x0_setparam_gatecfg2(const struct device *const dev, uint32_t val) { }
-#endif
 GEN_SETPARAM(config, CONFIG)
 GEN_SETPARAM(status, STATUS)
 
 #define GEN_GETPARAM(fname, pname)					\
-	static inline int l64x0_getparam_ ##fname(const struct device *const dev) \
+	static inline int l64x0_getparam_ ##fname(const struct device *const dev, uint32_t *val) \
 	{								\
-		return l64x0_getparam(dev, L64x0_ADDR_ ##pname); \
+		return l64x0_getparam(dev, L64x0_ADDR_ ##pname, val);	\
 	}
 
 GEN_GETPARAM(abs_pos, ABS_POS)
@@ -485,12 +926,9 @@ GEN_GETPARAM(stall_th, STALL_TH)
 GEN_GETPARAM(fs_spd, FS_SPD)
 GEN_GETPARAM(step_mode, STEP_MODE)
 GEN_GETPARAM(alarm_en, ALARM_EN)
-#if IS_ENABLED(CONFIG_L6480)
 GEN_GETPARAM(gatecfg1, GATECFG1)
 GEN_GETPARAM(gatecfg2, GATECFG2)
-#else
-static inline int l64x0_getparam_gatecfg1(const struct device *const dev) { return 0; }
-static inline int l64x0_getparam_gatecfg2(const struct device *const dev) { return 0; }
-#endif
 GEN_GETPARAM(config, CONFIG)
 GEN_GETPARAM(status, STATUS)
+
+#endif /* L64X0_H_ */
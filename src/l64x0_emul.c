@@ -0,0 +1,953 @@
+/*
+ * Copyright (c) 2023 Space Cubics, LLC.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(l64x0_emul, LOG_LEVEL_INF);
+
+#include "l64x0_emul.h"
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/drivers/spi_emul.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/sys/util.h>
+#include <string.h>
+
+#define ADDR_COUNT (0x20)
+
+/* Latched flags, by enum l64x0_alarm, plus the L6470's separate NOTPERF_CMD */
+#define LATCH_NOTPERF (L64X0_ALARM_COUNT)
+
+/* Update step of the motion model */
+#define STEP_US (1000)
+
+/*
+ * The chip as seen from the SPI bus, by register address. Widths and
+ * reset values follow the datasheets rather than the driver's tables.
+ */
+struct l64x0_emul_variant {
+	uint8_t bit_len[ADDR_COUNT];
+	uint32_t reset[ADDR_COUNT];
+	uint8_t config;
+	uint8_t status;
+	/* Registers whose writes are ignored unless the bridges are in HiZ */
+	uint32_t hiz_only;
+	uint16_t (*status_bits)(uint16_t latched, bool stck_mod);
+};
+
+static uint16_t l6470_status_bits(uint16_t latched, bool stck_mod)
+{
+	uint16_t status = L6470_STATUS_STEP_LOSS_B | L6470_STATUS_STEP_LOSS_A |
+			  L6470_STATUS_OCD | L6470_STATUS_TH_SD | L6470_STATUS_TH_WRN |
+			  L6470_STATUS_UVLO;
+
+	status &= ~((latched & BIT(L64X0_ALARM_STEP_LOSS_B)) ? L6470_STATUS_STEP_LOSS_B : 0);
+	status &= ~((latched & BIT(L64X0_ALARM_STEP_LOSS_A)) ? L6470_STATUS_STEP_LOSS_A : 0);
+	status &= ~((latched & BIT(L64X0_ALARM_OCD)) ? L6470_STATUS_OCD : 0);
+	status &= ~((latched & BIT(L64X0_ALARM_TH_SD)) ? L6470_STATUS_TH_SD : 0);
+	status &= ~((latched & BIT(L64X0_ALARM_TH_WRN)) ? L6470_STATUS_TH_WRN : 0);
+	status &= ~((latched & BIT(L64X0_ALARM_UVLO)) ? L6470_STATUS_UVLO : 0);
+	status |= (latched & BIT(L64X0_ALARM_CMD_ERROR)) ? L6470_STATUS_WRONG_CMD : 0;
+	status |= (latched & BIT(LATCH_NOTPERF)) ? L6470_STATUS_NOTPERF_CMD : 0;
+	status |= (latched & BIT(L64X0_ALARM_SW_EVN)) ? L6470_STATUS_SW_EVN : 0;
+	status |= stck_mod ? L6470_STATUS_SCK_MOD : 0;
+
+	return status;
+}
+
+static uint16_t l6480_status_bits(uint16_t latched, bool stck_mod)
+{
+	uint16_t status = L6480_STATUS_STEP_LOSS_B | L6480_STATUS_STEP_LOSS_A |
+			  L6480_STATUS_OCD | L6480_STATUS_UVLO_ADC | L6480_STATUS_UVLO;
+
+	status &= ~((latched & BIT(L64X0_ALARM_STEP_LOSS_B)) ? L6480_STATUS_STEP_LOSS_B : 0);
+	status &= ~((latched & BIT(L64X0_ALARM_STEP_LOSS_A)) ? L6480_STATUS_STEP_LOSS_A : 0);
+	status &= ~((latched & BIT(L64X0_ALARM_OCD)) ? L6480_STATUS_OCD : 0);
+	status &= ~((latched & BIT(L64X0_ALARM_UVLO_ADC)) ? L6480_STATUS_UVLO_ADC : 0);
+	status &= ~((latched & BIT(L64X0_ALARM_UVLO)) ? L6480_STATUS_UVLO : 0);
+	if (latched & BIT(L64X0_ALARM_TH_SD)) {
+		status |= L6480_STATUS_TH_STATUS(2);
+	} else if (latched & BIT(L64X0_ALARM_TH_WRN)) {
+		status |= L6480_STATUS_TH_STATUS(1);
+	}
+	status |= (latched & (BIT(L64X0_ALARM_CMD_ERROR) | BIT(LATCH_NOTPERF))) ?
+		  L6480_STATUS_CMD_ERROR : 0;
+	status |= (latched & BIT(L64X0_ALARM_SW_EVN)) ? L6480_STATUS_SW_EVN : 0;
+	status |= stck_mod ? L6480_STATUS_STCK_MOD : 0;
+
+	return status;
+}
+
+/* ACC, DEC, MIN_SPEED and ALARM_EN */
+#define STOPPED_ONLY (BIT(0x05) | BIT(0x06) | BIT(0x08) | BIT(0x17))
+/* INT_SPEED, ST_SLP, FN_SLP_ACC, FN_SLP_DEC and STEP_MODE */
+#define HIZ_ONLY (BIT(0x0d) | BIT(0x0e) | BIT(0x0f) | BIT(0x10) | BIT(0x16))
+
+#define EMUL_COMMON_REGS						\
+	.bit_len = {							\
+		[0x01] = 22, [0x02] = 9, [0x03] = 22, [0x04] = 20,	\
+		[0x05] = 12, [0x06] = 12, [0x07] = 10, [0x08] = 13,	\
+		[0x09] = 8, [0x0a] = 8, [0x0b] = 8, [0x0c] = 8,		\
+		[0x0d] = 14, [0x0e] = 8, [0x0f] = 8, [0x10] = 8,	\
+		[0x11] = 4, [0x12] = 5, [0x16] = 8, [0x17] = 8,		\
+		EMUL_VARIANT_BIT_LEN					\
+	},								\
+	.reset = {							\
+		[0x05] = 0x08a, [0x06] = 0x08a, [0x07] = 0x041,		\
+		[0x09] = 0x29, [0x0a] = 0x29, [0x0b] = 0x29, [0x0c] = 0x29, \
+		[0x0d] = 0x0408, [0x0e] = 0x19, [0x0f] = 0x29, [0x10] = 0x29, \
+		[0x13] = 0x08, [0x15] = 0x027, [0x16] = 0x07, [0x17] = 0xff, \
+		EMUL_VARIANT_RESET					\
+	}
+
+#define EMUL_VARIANT_BIT_LEN [0x13] = 4, [0x14] = 7, [0x15] = 10, [0x18] = 16, [0x19] = 16
+#define EMUL_VARIANT_RESET [0x14] = 0x40, [0x18] = 0x2e88
+static const struct l64x0_emul_variant l6470_emul_variant = {
+	EMUL_COMMON_REGS,
+	.config = 0x18,
+	.status = 0x19,
+	/* CONFIG too */
+	.hiz_only = HIZ_ONLY | BIT(0x18),
+	.status_bits = l6470_status_bits,
+};
+#undef EMUL_VARIANT_BIT_LEN
+#undef EMUL_VARIANT_RESET
+
+#define EMUL_VARIANT_BIT_LEN [0x13] = 5, [0x14] = 5, [0x15] = 11, [0x18] = 11, [0x19] = 8, \
+			     [0x1a] = 16, [0x1b] = 16
+#define EMUL_VARIANT_RESET [0x14] = 0x10, [0x1a] = 0x2c88
+static const struct l64x0_emul_variant l6480_emul_variant = {
+	EMUL_COMMON_REGS,
+	.config = 0x1a,
+	.status = 0x1b,
+	/* GATECFG1, GATECFG2 and CONFIG too */
+	.hiz_only = HIZ_ONLY | BIT(0x18) | BIT(0x19) | BIT(0x1a),
+	.status_bits = l6480_status_bits,
+};
+#undef EMUL_VARIANT_BIT_LEN
+#undef EMUL_VARIANT_RESET
+
+/* MOT_STATUS */
+enum l64x0_emul_mot {
+	MOT_STOPPED,
+	MOT_ACC,
+	MOT_DEC,
+	MOT_CONST,
+};
+
+enum l64x0_emul_mode {
+	MODE_STOPPED,
+	MODE_RUN,
+	/* MOVE, GOTO, GOTO_DIR, GO_HOME and GO_MARK: a number of steps left */
+	MODE_STEPS,
+	MODE_SOFT_STOP,
+	MODE_GO_UNTIL,
+	MODE_RELEASE_SW,
+	MODE_STEP_CLOCK,
+};
+
+struct l64x0_emul_chip_config {
+	const struct l64x0_emul_variant *variant;
+	/* Optional, port is NULL when the pin is not wired */
+	struct gpio_dt_spec flag;
+	struct gpio_dt_spec busy;
+};
+
+struct l64x0_emul_chip {
+	const struct l64x0_emul_chip_config *config;
+	const struct l64x0_emul_variant *variant;
+	uint32_t regs[ADDR_COUNT];
+	uint16_t latched;
+	/* Command being received */
+	uint8_t cmd;
+	uint8_t arg_left;
+	uint32_t arg;
+	/* Response being shifted out */
+	uint8_t out[3];
+	uint8_t out_len;
+	uint8_t out_pos;
+	/* Motion, speed in SPEED register units */
+	enum l64x0_emul_mode mode;
+	enum l64x0_emul_mot mot;
+	bool dir;
+	bool hiz;
+	bool hiz_after_stop;
+	bool sw_closed;
+	bool act;
+	uint32_t speed;
+	uint32_t run_speed;
+	uint32_t steps_left;
+	int32_t pos;
+	/* Fraction of a step, in 2^-26 steps */
+	uint32_t frac;
+	int64_t last_us;
+};
+
+struct l64x0_emul_config {
+	uint8_t length;
+	const struct l64x0_emul_chip_config *chips;
+};
+
+struct l64x0_emul_data {
+	struct k_spinlock lock;
+	/* Advances the motion while a chip moves, so BUSY and FLAG follow it */
+	struct k_timer timer;
+	struct l64x0_emul_chip *chips;
+	struct l64x0_emul_stats stats;
+	/* Wire time not yet waited for, below a microsecond */
+	uint32_t wire_ns;
+};
+
+#define ABS_POS_MASK GENMASK(21, 0)
+
+static inline int32_t sign_extend_22(uint32_t val)
+{
+	return (int32_t)(val << 10) >> 10;
+}
+
+static uint16_t l64x0_emul_status(const struct l64x0_emul_chip *chip)
+{
+	const struct l64x0_emul_variant *variant = chip->variant;
+	uint16_t status = variant->status_bits(chip->latched, chip->mode == MODE_STEP_CLOCK);
+
+	status |= L64X0_STATUS_MOT_STATUS(chip->mot);
+	status |= chip->dir ? L64X0_STATUS_DIR : 0;
+	status |= chip->hiz ? L64X0_STATUS_HIZ : 0;
+	status |= chip->sw_closed ? L64X0_STATUS_SW_F : 0;
+
+	/* BUSY is active low: high once the commanded motion is reached */
+	if (chip->mode == MODE_STOPPED || chip->mode == MODE_STEP_CLOCK ||
+	    (chip->mode == MODE_RUN && chip->mot == MOT_CONST)) {
+		status |= L64X0_STATUS_BUSY;
+	}
+
+	return status;
+}
+
+static uint32_t l64x0_emul_read_reg(const struct l64x0_emul_chip *chip, uint8_t addr)
+{
+	const struct l64x0_emul_variant *variant = chip->variant;
+
+	if (addr == variant->status) {
+		return l64x0_emul_status(chip);
+	}
+
+	switch (addr) {
+	case 0x01:
+		return (uint32_t)chip->pos & ABS_POS_MASK;
+	case 0x04:
+		return chip->speed;
+	default:
+		return chip->regs[addr];
+	}
+}
+
+static void l64x0_emul_reset(struct l64x0_emul_chip *chip)
+{
+	const struct l64x0_emul_variant *variant = chip->variant;
+
+	memcpy(chip->regs, variant->reset, sizeof(chip->regs));
+	chip->latched = 0;
+	chip->arg_left = 0;
+	chip->out_len = 0;
+	chip->out_pos = 0;
+	chip->mode = MODE_STOPPED;
+	chip->mot = MOT_STOPPED;
+	chip->dir = false;
+	chip->hiz = true;
+	chip->hiz_after_stop = false;
+	chip->speed = 0;
+	chip->pos = 0;
+	chip->frac = 0;
+}
+
+/* Alarm to ALARM_EN bit */
+static const uint8_t alarm_en_bit[] = {
+	[L64X0_ALARM_OCD] = 0,
+	[L64X0_ALARM_TH_SD] = 1,
+	[L64X0_ALARM_TH_WRN] = 2,
+	[L64X0_ALARM_UVLO] = 3,
+	[L64X0_ALARM_UVLO_ADC] = 3,
+	[L64X0_ALARM_STEP_LOSS_A] = 4,
+	[L64X0_ALARM_STEP_LOSS_B] = 5,
+	[L64X0_ALARM_SW_EVN] = 6,
+	[L64X0_ALARM_CMD_ERROR] = 7,
+	[LATCH_NOTPERF] = 7,
+};
+
+static bool l64x0_emul_flag(const struct l64x0_emul_chip *chip)
+{
+	for (int i = 0; i < ARRAY_SIZE(alarm_en_bit); i++) {
+		if ((chip->latched & BIT(i)) && (chip->regs[0x17] & BIT(alarm_en_bit[i]))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void l64x0_emul_stop(struct l64x0_emul_chip *chip)
+{
+	chip->speed = 0;
+	chip->frac = 0;
+	chip->mode = MODE_STOPPED;
+	chip->mot = MOT_STOPPED;
+	if (chip->hiz_after_stop) {
+		chip->hiz = true;
+		chip->hiz_after_stop = false;
+	}
+}
+
+static void l64x0_emul_switch_action(struct l64x0_emul_chip *chip)
+{
+	if (chip->act) {
+		chip->regs[0x03] = (uint32_t)chip->pos & ABS_POS_MASK;
+	} else {
+		chip->pos = 0;
+	}
+}
+
+/* Trapezoidal profile, dt at most STEP_US */
+static void l64x0_emul_step(struct l64x0_emul_chip *chip, uint32_t dt)
+{
+	uint32_t max = chip->regs[0x07] << 10;
+	uint32_t min = (chip->regs[0x08] & GENMASK(11, 0)) << 4;
+	/* ACC and DEC are 2^-40 step/tick^2, that is ACC / 1024 SPEED units per us */
+	uint32_t dv_acc = MAX(1, (chip->regs[0x05] * dt) >> 10);
+	uint32_t dv_dec = MAX(1, (chip->regs[0x06] * dt) >> 10);
+	uint32_t target;
+	uint32_t steps;
+
+	switch (chip->mode) {
+	case MODE_RUN:
+	case MODE_GO_UNTIL:
+		target = MIN(chip->run_speed, max);
+		break;
+	case MODE_RELEASE_SW:
+		target = min;
+		break;
+	case MODE_STEPS: {
+		/* Steps needed to brake: v^2 / (2 * DEC) in the units above */
+		uint64_t brake = ((uint64_t)chip->speed * chip->speed /
+				  MAX(1, chip->regs[0x06])) >> 17;
+
+		target = (chip->steps_left <= brake) ? MAX(min, BIT(10)) : max;
+		break;
+	}
+	case MODE_SOFT_STOP:
+		target = 0;
+		break;
+	default:
+		return;
+	}
+
+	if (chip->speed < target) {
+		chip->speed = MIN(chip->speed + dv_acc, target);
+		chip->mot = MOT_ACC;
+	} else if (chip->speed > target) {
+		chip->speed = (chip->speed > target + dv_dec) ? chip->speed - dv_dec : target;
+		chip->mot = MOT_DEC;
+	} else {
+		chip->mot = MOT_CONST;
+	}
+
+	/* SPEED is 2^-28 step/tick, 4 ticks per us */
+	chip->frac += chip->speed * dt;
+	steps = chip->frac >> 26;
+	chip->frac &= GENMASK(25, 0);
+
+	if (chip->mode == MODE_STEPS) {
+		steps = MIN(steps, chip->steps_left);
+		chip->steps_left -= steps;
+	}
+
+	chip->pos = sign_extend_22(chip->pos + (chip->dir ? (int32_t)steps : -(int32_t)steps));
+
+	if ((chip->mode == MODE_STEPS && chip->steps_left == 0) ||
+	    (chip->mode == MODE_SOFT_STOP && chip->speed == 0)) {
+		l64x0_emul_stop(chip);
+	}
+}
+
+static void l64x0_emul_update(struct l64x0_emul_chip *chip, int64_t now_us)
+{
+	int64_t dt = now_us - chip->last_us;
+
+	chip->last_us = now_us;
+
+	while (chip->mode != MODE_STOPPED && chip->mode != MODE_STEP_CLOCK && dt > 0) {
+		l64x0_emul_step(chip, MIN(dt, STEP_US));
+		dt -= STEP_US;
+	}
+}
+
+static bool l64x0_emul_moving(const struct l64x0_emul_chip *chip)
+{
+	return chip->mode != MODE_STOPPED && chip->mode != MODE_STEP_CLOCK;
+}
+
+static void l64x0_emul_start(struct l64x0_emul_chip *chip, enum l64x0_emul_mode mode, bool dir)
+{
+	/* A change of direction needs the motor stopped first; keep it simple */
+	if (chip->speed != 0 && dir != chip->dir) {
+		chip->speed = 0;
+	}
+
+	chip->mode = mode;
+	chip->mot = MOT_ACC;
+	chip->dir = dir;
+	chip->hiz = false;
+	chip->hiz_after_stop = false;
+}
+
+static void l64x0_emul_goto(struct l64x0_emul_chip *chip, uint32_t abs_pos, int forced_dir)
+{
+	uint32_t diff = (abs_pos - (uint32_t)chip->pos) & ABS_POS_MASK;
+	bool dir = (forced_dir >= 0) ? forced_dir : (diff < BIT(21));
+
+	chip->steps_left = dir ? diff : (BIT(22) - diff) & ABS_POS_MASK;
+	l64x0_emul_start(chip, MODE_STEPS, dir);
+	if (chip->steps_left == 0) {
+		l64x0_emul_stop(chip);
+	}
+}
+
+static void l64x0_emul_latch(struct l64x0_emul_chip *chip, int flag)
+{
+	chip->latched |= BIT(flag);
+}
+
+static bool l64x0_emul_busy(const struct l64x0_emul_chip *chip)
+{
+	return !(l64x0_emul_status(chip) & L64X0_STATUS_BUSY);
+}
+
+/* MOVE and STEP_CLOCK need the motor stopped, the GOTOs only BUSY released */
+static bool l64x0_emul_refuse(struct l64x0_emul_chip *chip, bool need_stopped)
+{
+	if (need_stopped ? chip->mode != MODE_STOPPED : l64x0_emul_busy(chip)) {
+		l64x0_emul_latch(chip, LATCH_NOTPERF);
+		return true;
+	}
+
+	return false;
+}
+
+/* Commands whose argument bytes have all been received */
+static void l64x0_emul_execute(struct l64x0_emul_chip *chip)
+{
+	const struct l64x0_emul_variant *variant = chip->variant;
+	uint8_t cmd = chip->cmd;
+	uint32_t arg = chip->arg;
+	bool dir = cmd & BIT(0);
+
+	if ((cmd & 0xe0) == 0x00) {
+		uint8_t addr = cmd & 0x1f;
+
+		arg &= GENMASK(variant->bit_len[addr] - 1, 0);
+		if (addr == 0x04 || addr == 0x12 || addr == variant->status) {
+			l64x0_emul_latch(chip, LATCH_NOTPERF);
+		} else if ((addr == 0x01 || addr == 0x02) && l64x0_emul_moving(chip)) {
+			l64x0_emul_latch(chip, LATCH_NOTPERF);
+		} else if ((variant->hiz_only & BIT(addr)) && !chip->hiz) {
+			l64x0_emul_latch(chip, LATCH_NOTPERF);
+		} else if ((STOPPED_ONLY & BIT(addr)) && chip->mode != MODE_STOPPED) {
+			l64x0_emul_latch(chip, LATCH_NOTPERF);
+		} else if (addr == 0x01) {
+			chip->pos = sign_extend_22(arg);
+		} else {
+			chip->regs[addr] = arg;
+		}
+		return;
+	}
+
+	switch (cmd & ~BIT(0)) {
+	case 0x50:
+		chip->run_speed = arg & GENMASK(19, 0);
+		l64x0_emul_start(chip, MODE_RUN, dir);
+		break;
+	case 0x40:
+		if (l64x0_emul_refuse(chip, true)) {
+			break;
+		}
+		chip->steps_left = arg & ABS_POS_MASK;
+		l64x0_emul_start(chip, MODE_STEPS, dir);
+		if (chip->steps_left == 0) {
+			l64x0_emul_stop(chip);
+		}
+		break;
+	case 0x60:
+		/* GOTO takes the shortest path, GOTO_DIR the given direction */
+		if (!l64x0_emul_refuse(chip, false)) {
+			l64x0_emul_goto(chip, arg, (cmd == 0x60) ? -1 : dir);
+		}
+		break;
+	case 0x68:
+		if (!l64x0_emul_refuse(chip, false)) {
+			l64x0_emul_goto(chip, arg, dir);
+		}
+		break;
+	case 0x82:
+	case 0x8a:
+		chip->run_speed = arg & GENMASK(19, 0);
+		chip->act = cmd & BIT(3);
+		l64x0_emul_start(chip, MODE_GO_UNTIL, dir);
+		break;
+	default:
+		l64x0_emul_latch(chip, L64X0_ALARM_CMD_ERROR);
+		break;
+	}
+}
+
+static void l64x0_emul_respond(struct l64x0_emul_chip *chip, uint32_t val, uint8_t len)
+{
+	for (int i = 0; i < len; i++) {
+		chip->out[i] = val >> (8 * (len - 1 - i));
+	}
+	chip->out_len = len;
+	chip->out_pos = 0;
+}
+
+/* First byte of a command */
+static void l64x0_emul_decode(struct l64x0_emul_chip *chip, uint8_t cmd)
+{
+	const struct l64x0_emul_variant *variant = chip->variant;
+	uint8_t addr = cmd & 0x1f;
+	bool dir = cmd & BIT(0);
+
+	chip->cmd = cmd;
+	chip->arg = 0;
+
+	/* NOP is SET_PARAM of address 0 */
+	if (cmd == 0x00) {
+		return;
+	}
+
+	if ((cmd & 0xe0) == 0x00 || (cmd & 0xe0) == 0x20) {
+		if (variant->bit_len[addr] == 0) {
+			l64x0_emul_latch(chip, L64X0_ALARM_CMD_ERROR);
+		} else if (cmd & 0x20) {
+			l64x0_emul_respond(chip, l64x0_emul_read_reg(chip, addr),
+					   DIV_ROUND_UP(variant->bit_len[addr], 8));
+		} else {
+			chip->arg_left = DIV_ROUND_UP(variant->bit_len[addr], 8);
+		}
+		return;
+	}
+
+	switch (cmd) {
+	case 0x50: case 0x51:	/* RUN */
+	case 0x40: case 0x41:	/* MOVE */
+	case 0x60:		/* GOTO */
+	case 0x68: case 0x69:	/* GOTO_DIR */
+	case 0x82: case 0x83: case 0x8a: case 0x8b:	/* GO_UNTIL */
+		chip->arg_left = 3;
+		break;
+	case 0x58: case 0x59:	/* STEP_CLOCK */
+		if (l64x0_emul_refuse(chip, true)) {
+			break;
+		}
+		l64x0_emul_start(chip, MODE_STEP_CLOCK, dir);
+		break;
+	case 0x92: case 0x93: case 0x9a: case 0x9b:	/* RELEASE_SW */
+		chip->act = cmd & BIT(3);
+		l64x0_emul_start(chip, MODE_RELEASE_SW, dir);
+		if (!chip->sw_closed) {
+			l64x0_emul_stop(chip);
+		}
+		break;
+	case 0x70:		/* GO_HOME */
+		if (!l64x0_emul_refuse(chip, false)) {
+			l64x0_emul_goto(chip, 0, -1);
+		}
+		break;
+	case 0x78:		/* GO_MARK */
+		if (!l64x0_emul_refuse(chip, false)) {
+			l64x0_emul_goto(chip, chip->regs[0x03], -1);
+		}
+		break;
+	case 0xd8:		/* RESET_POS */
+		chip->pos = 0;
+		break;
+	case 0xc0:		/* RESET_DEVICE */
+		l64x0_emul_reset(chip);
+		break;
+	case 0xb0:		/* SOFT_STOP */
+	case 0xa0:		/* SOFT_HIZ */
+		if (l64x0_emul_moving(chip)) {
+			chip->mode = MODE_SOFT_STOP;
+			chip->hiz_after_stop = (cmd == 0xa0);
+		} else {
+			chip->mode = MODE_STOPPED;
+			chip->hiz = chip->hiz || (cmd == 0xa0);
+		}
+		break;
+	case 0xb8:		/* HARD_STOP */
+	case 0xa8:		/* HARD_HIZ */
+		l64x0_emul_stop(chip);
+		chip->hiz = chip->hiz || (cmd == 0xa8);
+		break;
+	case 0xd0:		/* GET_STATUS, which clears the latched flags */
+		l64x0_emul_respond(chip, l64x0_emul_status(chip), 2);
+		chip->latched = 0;
+		break;
+	default:
+		l64x0_emul_latch(chip, L64X0_ALARM_CMD_ERROR);
+		break;
+	}
+}
+
+/* One byte time: the byte shifted out is what the chip had queued */
+static uint8_t l64x0_emul_byte(struct l64x0_emul_chip *chip, uint8_t in)
+{
+	/* Bytes clocked in during a response are ignored */
+	if (chip->out_pos < chip->out_len) {
+		return chip->out[chip->out_pos++];
+	}
+
+	if (chip->arg_left > 0) {
+		chip->arg = (chip->arg << 8) | in;
+		if (--chip->arg_left == 0) {
+			l64x0_emul_execute(chip);
+		}
+		return 0;
+	}
+
+	l64x0_emul_decode(chip, in);
+
+	return 0;
+}
+
+static void l64x0_emul_set_pin(const struct gpio_dt_spec *spec, bool active)
+{
+	if (spec->port == NULL) {
+		return;
+	}
+
+	gpio_emul_input_set(spec->port, spec->pin,
+			    (spec->dt_flags & GPIO_ACTIVE_LOW) ? !active : active);
+}
+
+/*
+ * Bring every chip to now, then report whether one still moves. Pin levels
+ * are returned so that GPIO callbacks run outside of the lock.
+ */
+static bool l64x0_emul_update_all(const struct emul *target, bool *flag, bool *busy)
+{
+	const struct l64x0_emul_config *config = target->cfg;
+	struct l64x0_emul_data *data = target->data;
+	int64_t now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+	bool moving = false;
+
+	for (uint8_t i = 0; i < config->length; i++) {
+		struct l64x0_emul_chip *chip = &data->chips[i];
+
+		l64x0_emul_update(chip, now_us);
+		moving |= l64x0_emul_moving(chip);
+		flag[i] = l64x0_emul_flag(chip);
+		busy[i] = l64x0_emul_busy(chip);
+	}
+
+	return moving;
+}
+
+static void l64x0_emul_apply_pins(const struct emul *target, const bool *flag, const bool *busy)
+{
+	const struct l64x0_emul_config *config = target->cfg;
+
+	for (uint8_t i = 0; i < config->length; i++) {
+		l64x0_emul_set_pin(&config->chips[i].flag, flag[i]);
+		l64x0_emul_set_pin(&config->chips[i].busy, busy[i]);
+	}
+}
+
+static void l64x0_emul_sync(const struct emul *target)
+{
+	struct l64x0_emul_data *data = target->data;
+	bool flag[32], busy[32];
+	k_spinlock_key_t key;
+	bool moving;
+
+	key = k_spin_lock(&data->lock);
+	moving = l64x0_emul_update_all(target, flag, busy);
+	k_spin_unlock(&data->lock, key);
+
+	l64x0_emul_apply_pins(target, flag, busy);
+
+	if (moving) {
+		k_timer_start(&data->timer, K_USEC(STEP_US), K_NO_WAIT);
+	}
+}
+
+static void l64x0_emul_timer(struct k_timer *timer)
+{
+	l64x0_emul_sync(k_timer_user_data_get(timer));
+}
+
+static int l64x0_emul_io(const struct emul *target, const struct spi_config *spi_cfg,
+			 const struct spi_buf_set *tx_bufs, const struct spi_buf_set *rx_bufs)
+{
+	const struct l64x0_emul_config *config = target->cfg;
+	struct l64x0_emul_data *data = target->data;
+	const struct spi_buf *tx = (tx_bufs != NULL) ? tx_bufs->buffers : NULL;
+	const struct spi_buf *rx = (rx_bufs != NULL) ? rx_bufs->buffers : NULL;
+	size_t len = (tx != NULL) ? tx->len : (rx != NULL) ? rx->len : 0;
+	bool flag[32], busy[32];
+	k_spinlock_key_t key;
+	uint64_t wire_ns;
+
+	if ((tx_bufs != NULL && tx_bufs->count > 1) || (rx_bufs != NULL && rx_bufs->count > 1) ||
+	    len % config->length != 0) {
+		LOG_ERR("expected whole byte times in a single buffer");
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&data->lock);
+	l64x0_emul_update_all(target, flag, busy);
+
+	data->stats.transfers++;
+	data->stats.bytes += len;
+	wire_ns = data->wire_ns;
+	if (spi_cfg->frequency > 0) {
+		wire_ns += (uint64_t)len * 8U * NSEC_PER_SEC / spi_cfg->frequency;
+	}
+	data->wire_ns = wire_ns % NSEC_PER_USEC;
+
+	/* The first byte shifted out reaches the last chip of the chain */
+	for (size_t b = 0; b < len; b += config->length) {
+		for (uint8_t slot = 0; slot < config->length; slot++) {
+			struct l64x0_emul_chip *chip = &data->chips[config->length - 1 - slot];
+			uint8_t in = (tx != NULL && tx->buf != NULL) ?
+				     ((const uint8_t *)tx->buf)[b + slot] : 0;
+			uint8_t out = l64x0_emul_byte(chip, in);
+
+			if (rx != NULL && rx->buf != NULL && b + slot < rx->len) {
+				((uint8_t *)rx->buf)[b + slot] = out;
+			}
+		}
+	}
+
+	k_spin_unlock(&data->lock, key);
+
+	/* Hold the caller for as long as the bytes take on the wire */
+	k_busy_wait(wire_ns / NSEC_PER_USEC);
+
+	/* Pins and the motion timer follow what the commands started */
+	l64x0_emul_sync(target);
+
+	return 0;
+}
+
+static struct l64x0_emul_chip *l64x0_emul_chip(const struct emul *target, uint8_t position)
+{
+	const struct l64x0_emul_config *config = target->cfg;
+	struct l64x0_emul_data *data = target->data;
+
+	return (position < config->length) ? &data->chips[position] : NULL;
+}
+
+int l64x0_emul_raise(const struct emul *target, uint8_t position, enum l64x0_alarm alarm)
+{
+	struct l64x0_emul_data *data = target->data;
+	struct l64x0_emul_chip *chip = l64x0_emul_chip(target, position);
+	k_spinlock_key_t key;
+
+	if (chip == NULL || alarm >= L64X0_ALARM_COUNT) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&data->lock);
+	l64x0_emul_latch(chip, alarm);
+	/* Like the chip, bridges are disabled on overcurrent and thermal shutdown */
+	if (alarm == L64X0_ALARM_TH_SD ||
+	    (alarm == L64X0_ALARM_OCD && (chip->regs[chip->variant->config] &
+					  L64X0_CONFIG_OC_SD))) {
+		l64x0_emul_stop(chip);
+		chip->hiz = true;
+	}
+	k_spin_unlock(&data->lock, key);
+
+	l64x0_emul_sync(target);
+
+	return 0;
+}
+
+int l64x0_emul_set_switch(const struct emul *target, uint8_t position, bool closed)
+{
+	struct l64x0_emul_data *data = target->data;
+	struct l64x0_emul_chip *chip = l64x0_emul_chip(target, position);
+	k_spinlock_key_t key;
+
+	if (chip == NULL) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&data->lock);
+	l64x0_emul_update(chip, k_ticks_to_us_floor64(k_uptime_ticks()));
+	if (closed && !chip->sw_closed) {
+		l64x0_emul_latch(chip, L64X0_ALARM_SW_EVN);
+		if (chip->mode == MODE_GO_UNTIL) {
+			l64x0_emul_switch_action(chip);
+			chip->mode = MODE_SOFT_STOP;
+		}
+	} else if (!closed && chip->sw_closed && chip->mode == MODE_RELEASE_SW) {
+		l64x0_emul_switch_action(chip);
+		l64x0_emul_stop(chip);
+	}
+	chip->sw_closed = closed;
+	k_spin_unlock(&data->lock, key);
+
+	l64x0_emul_sync(target);
+
+	return 0;
+}
+
+int l64x0_emul_set_adc(const struct emul *target, uint8_t position, uint8_t adc_out)
+{
+	struct l64x0_emul_data *data = target->data;
+	struct l64x0_emul_chip *chip = l64x0_emul_chip(target, position);
+	k_spinlock_key_t key;
+
+	if (chip == NULL) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&data->lock);
+	chip->regs[0x12] = adc_out & GENMASK(4, 0);
+	k_spin_unlock(&data->lock, key);
+
+	return 0;
+}
+
+int l64x0_emul_get_reg(const struct emul *target, uint8_t position, uint8_t addr,
+		       uint32_t *val)
+{
+	struct l64x0_emul_data *data = target->data;
+	struct l64x0_emul_chip *chip = l64x0_emul_chip(target, position);
+	k_spinlock_key_t key;
+
+	if (chip == NULL || addr >= ADDR_COUNT || chip->variant->bit_len[addr] == 0) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&data->lock);
+	l64x0_emul_update(chip, k_ticks_to_us_floor64(k_uptime_ticks()));
+	*val = l64x0_emul_read_reg(chip, addr);
+	k_spin_unlock(&data->lock, key);
+
+	return 0;
+}
+
+void l64x0_emul_get_stats(const struct emul *target, struct l64x0_emul_stats *stats)
+{
+	struct l64x0_emul_data *data = target->data;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&data->lock);
+	*stats = data->stats;
+	k_spin_unlock(&data->lock, key);
+}
+
+void l64x0_emul_reset_stats(const struct emul *target)
+{
+	struct l64x0_emul_data *data = target->data;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&data->lock);
+	memset(&data->stats, 0, sizeof(data->stats));
+	k_spin_unlock(&data->lock, key);
+}
+
+static const struct spi_emul_api l64x0_emul_api = {
+	.io = l64x0_emul_io,
+};
+
+static int l64x0_emul_init(const struct emul *target, const struct device *parent)
+{
+	const struct l64x0_emul_config *config = target->cfg;
+	struct l64x0_emul_data *data = target->data;
+
+	ARG_UNUSED(parent);
+
+	k_timer_init(&data->timer, l64x0_emul_timer, NULL);
+	k_timer_user_data_set(&data->timer, (void *)target);
+
+	for (uint8_t i = 0; i < config->length; i++) {
+		struct l64x0_emul_chip *chip = &data->chips[i];
+
+		chip->config = &config->chips[i];
+		/* Chain positions without a node are left zeroed, as an L6470 */
+		chip->variant = (chip->config->variant != NULL) ? chip->config->variant :
+				&l6470_emul_variant;
+		l64x0_emul_reset(chip);
+		chip->last_us = k_ticks_to_us_floor64(k_uptime_ticks());
+		/* Power up leaves UVLO latched until the first GET_STATUS */
+		l64x0_emul_latch(chip, L64X0_ALARM_UVLO);
+	}
+
+	l64x0_emul_sync(target);
+
+	return 0;
+}
+
+#define L64X0_EMUL_CHIP(node_id, chip)					\
+	{								\
+		.variant = &chip##_emul_variant,			\
+		.flag = GPIO_DT_SPEC_GET_OR(node_id, flag_gpios, {0}),	\
+		.busy = GPIO_DT_SPEC_GET_OR(node_id, busy_gpios, {0}),	\
+	}
+
+#define Z_L64X0_EMUL_DEFINE(node_id, n_chips, chip_configs)		\
+	static const struct l64x0_emul_chip_config			\
+		UTIL_CAT(l64x0_emul_chips_cfg_, DT_DEP_ORD(node_id))[n_chips] = { \
+		__DEBRACKET chip_configs				\
+	};								\
+	static struct l64x0_emul_chip					\
+		UTIL_CAT(l64x0_emul_chips_, DT_DEP_ORD(node_id))[n_chips]; \
+	static const struct l64x0_emul_config				\
+		UTIL_CAT(l64x0_emul_cfg_, DT_DEP_ORD(node_id)) = {	\
+		.length = n_chips,					\
+		.chips = UTIL_CAT(l64x0_emul_chips_cfg_, DT_DEP_ORD(node_id)), \
+	};								\
+	static struct l64x0_emul_data					\
+		UTIL_CAT(l64x0_emul_data_, DT_DEP_ORD(node_id)) = {	\
+		.chips = UTIL_CAT(l64x0_emul_chips_, DT_DEP_ORD(node_id)), \
+	};								\
+	EMUL_DT_DEFINE(node_id, l64x0_emul_init,			\
+		       &UTIL_CAT(l64x0_emul_data_, DT_DEP_ORD(node_id)), \
+		       &UTIL_CAT(l64x0_emul_cfg_, DT_DEP_ORD(node_id)),	\
+		       &l64x0_emul_api, NULL);
+
+/* Only chips and chains that sit on the SPI emulator controller */
+#define L64X0_EMUL_ON_EMUL(node_id)					\
+	DT_NODE_HAS_COMPAT(DT_PARENT(node_id), zephyr_spi_emul_controller)
+
+#define L64X0_EMUL_SINGLE(node_id, chip)				\
+	IF_ENABLED(L64X0_EMUL_ON_EMUL(node_id),				\
+		   (Z_L64X0_EMUL_DEFINE(node_id, 1,			\
+					(L64X0_EMUL_CHIP(node_id, chip)))))
+
+#define L64X0_EMUL_L6470(node_id) L64X0_EMUL_SINGLE(node_id, l6470)
+#define L64X0_EMUL_L6480(node_id) L64X0_EMUL_SINGLE(node_id, l6480)
+
+DT_FOREACH_STATUS_OKAY(st_l6470, L64X0_EMUL_L6470)
+DT_FOREACH_STATUS_OKAY(st_l6480, L64X0_EMUL_L6480)
+
+/* A chain models every position, see l64x0_emul_init() for the others */
+#define L64X0_EMUL_CHAIN_CHIP(child)					\
+	[DT_REG_ADDR(child)] = COND_CODE_1(DT_NODE_HAS_COMPAT(child, st_l6480), \
+					   (L64X0_EMUL_CHIP(child, l6480)), \
+					   (L64X0_EMUL_CHIP(child, l6470))),
+
+#define L64X0_EMUL_CHAIN(node_id)					\
+	IF_ENABLED(L64X0_EMUL_ON_EMUL(node_id),				\
+		   (Z_L64X0_EMUL_DEFINE(node_id, DT_PROP(node_id, chain_length), \
+			(DT_FOREACH_CHILD_STATUS_OKAY(node_id,		\
+						      L64X0_EMUL_CHAIN_CHIP)))))
+
+DT_FOREACH_STATUS_OKAY(st_l64x0_daisy_chain, L64X0_EMUL_CHAIN)
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2023 Space Cubics, LLC.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef L64X0_EMUL_H_
+#define L64X0_EMUL_H_
+
+#include <zephyr/drivers/emul.h>
+
+#include "l64x0.h"
+
+/*
+ * Test hooks of the SPI emulator. An emulator models one chip, or every
+ * chip of an st,l64x0-daisy-chain; position is the chip's position in
+ * the chain, 0 for a chip on its own chip select.
+ */
+
+/* Latch a fault or event as the chip would, asserting FLAG if enabled */
+int l64x0_emul_raise(const struct emul *target, uint8_t position, enum l64x0_alarm alarm);
+
+/* Drive the SW input, which GO_UNTIL and RELEASE_SW wait on */
+int l64x0_emul_set_switch(const struct emul *target, uint8_t position, bool closed);
+
+/* Value returned in ADC_OUT */
+int l64x0_emul_set_adc(const struct emul *target, uint8_t position, uint8_t adc_out);
+
+/* Current value of a register, by chip address, without side effects */
+int l64x0_emul_get_reg(const struct emul *target, uint8_t position, uint8_t addr,
+		       uint32_t *val);
+
+/* SPI traffic seen by an emulator */
+struct l64x0_emul_stats {
+	/* SPI API calls, one per chip select period */
+	uint32_t transfers;
+	/* Bytes shifted, NOP padding included */
+	uint32_t bytes;
+};
+
+/* Traffic since boot or the last l64x0_emul_reset_stats() */
+void l64x0_emul_get_stats(const struct emul *target, struct l64x0_emul_stats *stats);
+
+void l64x0_emul_reset_stats(const struct emul *target);
+
+#endif /* L64X0_EMUL_H_ */
@@ -9,6 +9,7 @@ LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/pm/device_runtime.h>
 #include <zephyr/sys/util.h>
 #include <stdlib.h>
 
@@ -16,12 +17,11 @@ LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 
 #define MOTOR_DRIVER DT_NODELABEL(motor_driver)
 
-#if IS_ENABLED(CONFIG_L6470)
-static void debug_print(const struct device *const dev, int count)
+static void debug_print_l6470(const struct l64x0_snapshot *snap, int count)
 {
-	uint16_t adc_out = l64x0_getparam_adc_out(dev);
-	uint32_t speed = l64x0_getparam_speed(dev);
-	uint32_t status = l64x0_get_status(dev);
+	uint16_t adc_out = snap->regs[L64x0_ADDR_ADC_OUT];
+	uint32_t speed = snap->regs[L64x0_ADDR_SPEED];
+	uint32_t status = snap->regs[L64x0_ADDR_STATUS];
 	printk("%d: Speed: %u (0x%x), Status: 0x%x (%s%s%s%s%s%s%s%s%s%s%s%s%s), ADC_OUT %x\n",
 	       count,
 	       speed, speed, status,
@@ -40,12 +40,12 @@ static void debug_print(const struct device *const dev, int count)
 	       (status & L6470_STATUS_HiZ) ? "HiZ" : "",
 	       adc_out);
 }
-#elif IS_ENABLED(CONFIG_L6480)
-static void debug_print(const struct device *const dev, int count)
+
+static void debug_print_l6480(const struct l64x0_snapshot *snap, int count)
 {
-	uint16_t adc_out = l64x0_getparam_adc_out(dev);
-	uint32_t speed = l64x0_getparam_speed(dev);
-	uint32_t status = l64x0_get_status(dev);
+	uint16_t adc_out = snap->regs[L64x0_ADDR_ADC_OUT];
+	uint32_t speed = snap->regs[L64x0_ADDR_SPEED];
+	uint32_t status = snap->regs[L64x0_ADDR_STATUS];
 	printk("%d: Speed: %u (0x%x), Status: 0x%x (%s%s%s%s%s%s%s%s%s%s%s%s), ADC_OUT %x\n",
 	       count,
 	       speed, speed, status,
@@ -63,10 +63,40 @@ static void debug_print(const struct device *const dev, int count)
 	       (status & L6480_STATUS_HiZ) ? "HiZ" : "",
 	       adc_out);
 }
-#endif
+
+static void debug_print(const struct device *const dev, int count)
+{
+	struct l64x0_snapshot snap;
+
+	if (l64x0_snapshot(dev, BIT(L64x0_ADDR_ADC_OUT) | BIT(L64x0_ADDR_SPEED) |
+			   BIT(L64x0_ADDR_STATUS), &snap) < 0) {
+		printk("%d: snapshot failed\n", count);
+		return;
+	}
+
+	if (l64x0_variant(dev) == L64X0_VARIANT_L6480) {
+		debug_print_l6480(&snap, count);
+	} else {
+		debug_print_l6470(&snap, count);
+	}
+}
+
+/* Runs from the system work queue when FLAG reports a fault */
+static void fault_handler(const struct device *dev, enum l64x0_alarm alarm,
+			  uint16_t status, void *user_data)
+{
+	printk("%s: alarm %d, Status: 0x%x\n", dev->name, alarm, status);
+	l64x0_hard_hiz(dev);
+}
 
 int main(void)
 {
+	static const enum l64x0_alarm faults[] = {
+		L64X0_ALARM_OCD,
+		L64X0_ALARM_TH_SD,
+		L64X0_ALARM_STEP_LOSS_A,
+		L64X0_ALARM_STEP_LOSS_B,
+	};
 	const struct device *const dev = DEVICE_DT_GET(MOTOR_DRIVER);
 
 	if (!device_is_ready(dev)) {
@@ -74,78 +104,28 @@ int main(void)
 		return EXIT_FAILURE;
 	}
 
-	const struct gpio_dt_spec n_stby =
-		GPIO_DT_SPEC_GET(DT_NODELABEL(motor_driver), stby_gpios);
-	if (!device_is_ready(n_stby.port)) {
-		printk("%s: device not ready.\n", dev->name);
+	/* Out of standby if runtime PM suspended it, a no-op otherwise */
+	if (pm_device_runtime_get(dev) < 0) {
+		printk("%s: resume failed.\n", dev->name);
 		return EXIT_FAILURE;
 	}
-	gpio_pin_configure_dt(&n_stby, GPIO_OUTPUT_ACTIVE);
-	k_usleep(10);
-	gpio_pin_set_dt(&n_stby, 0);
 
-	k_sleep(K_MSEC(1));
-
-
-	l64x0_nop(dev);
-	l64x0_nop(dev);
-	l64x0_nop(dev);
-	l64x0_nop(dev);
-	l64x0_reset_device(dev);
-	k_usleep(500);
+	/* The driver has reset and configured the chip from devicetree */
 	debug_print(dev, -1);
 
-	/* K_VAL = (K_VAL_X + BEMF_COMP) * VSCOMP * K_THERM) * microstep */
-	/* No compensation is active */
-	/** The K_VALs */
-	l64x0_setparam_kval_hold(dev, L64X0_KVAL_X_256TH(22));
-	l64x0_setparam_kval_acc(dev, L64X0_KVAL_X_256TH(22));
-	l64x0_setparam_kval_dec(dev, L64X0_KVAL_X_256TH(22));
-	l64x0_setparam_kval_run(dev, L64X0_KVAL_X_256TH(22));
-
-	/** No BEMF for now */
-	/* l64x0_setparam_st_slp(dev, 0); */
-	/* l64x0_setparam_fn_slp_acc(dev, 0); */
-	/* l64x0_setparam_fn_slp_dec(dev, 0); */
-
-	/** VSCOMP is at CONFIG register */
-	/** K_THERM is default 0 */
-
-	/** 128 micro-steps */
-	l64x0_setparam_step_mode(dev, L64X0_STEP_MODE_128TH);
-
-	/* Accel and speed */
-	l64x0_setparam_acc(dev, 0x19);
-	l64x0_setparam_dec(dev, 0x10);
-	l64x0_setparam_max_speed(dev, 30);
-	l64x0_setparam_min_speed(dev, 1, false);
-
-	l64x0_setparam_fs_spd(dev, 0x3ff);
-
-	if (IS_ENABLED(CONFIG_L6470)) {
-		/* OCD and Stall */
-		l64x0_setparam_ocd_th(dev, L6470_OCD_TH_4125_mV);
-		l64x0_setparam_stall_th(dev, L6470_STALL_TH_4000_mA);
-	}
-	else if (IS_ENABLED(CONFIG_L6480)) {
-		/* OCD and Stall */
-		l64x0_setparam_ocd_th(dev, L6480_OCD_TH_125_mV);
-		l64x0_setparam_stall_th(dev, L6480_STALL_TH_125_mV);
-
-		/* Gate Drive */
-		l64x0_setparam_gatecfg1(dev, L6480_IGATE_8_mA | L6480_TCC_2875_ns);
-
-		/* Configs */
-		uint32_t reg;
-		reg = l64x0_getparam_config(dev);
-		l64x0_setparam_config(dev, reg | L6480_CONFIG_VCCVAL | L6480_CONFIG_UVLOVAL);
+	for (int i = 0; i < ARRAY_SIZE(faults); i++) {
+		if (l64x0_alarm_callback_set(dev, faults[i], fault_handler, NULL) < 0) {
+			printk("no flag-gpios, faults are only seen in the status below\n");
+			break;
+		}
 	}
 
-	/* Now setttings are all done, wait for the charge pump to be above the threshold */
-	WAIT_FOR(l64x0_get_status(dev) & L64X0_STATUS_UVLO, 2000, printk("."));
-	printk("\n");
+	/* Wait for the charge pump to be above the threshold */
+	if (l64x0_wait_ready(dev, K_SECONDS(2)) < 0) {
+		printk("%s: still in UVLO\n", dev->name);
+	}
 
-	l64x0_run(dev, 0x8000);
+	l64x0_run(dev, L64X0_SPEED(488));
 	//l64x0_move(dev, 0x128000);
 	//l64x0_soft_stop(dev);
 
@@ -155,6 +135,7 @@ int main(void)
 	}
 	printk("loop end\n");
 	l64x0_soft_hiz(dev);
+	pm_device_runtime_put(dev);
 	printk("done\n");
 
 	return EXIT_SUCCESS;